@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/* =========================================================== */
+/* ==================== Allocation Counter =================== */
+/* =========================================================== */
+
+/* Allocations made by the current thread, for benchmarks reporting allocations per operation. Counting replaces the
+global operator new, so it is only compiled into bench builds (-DBENCH_BUILD) and other builds keep the default
+allocator, getThreadAllocations() then always returns 0. The replacement may be defined once per program, so only
+the translation unit holding main should include this header. */
+#ifdef BENCH_BUILD
+const bool ALLOCATIONS_COUNTED = true;
+
+inline thread_local uint64_t threadAllocations = 0;
+
+/* The default operator delete releases memory with free. Kept out of line so that the compiler does not pair the
+inlined malloc with operator delete. */
+__attribute__((noinline)) void* operator new(std::size_t size)
+{
+    threadAllocations++;
+    void *memory = std::malloc(size > 0 ? size : 1);
+    if (memory == NULL)
+        throw std::bad_alloc();
+    return memory;
+}
+
+inline uint64_t getThreadAllocations() {
+    return threadAllocations;
+}
+#else
+const bool ALLOCATIONS_COUNTED = false;
+
+inline uint64_t getThreadAllocations() {
+    return 0;
+}
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <time.h>
+
+/* =========================================================== */
+/* ======================= ID Generator ====================== */
+/* =========================================================== */
+
+/* Thread safe generator of unique 64 bit ids, shared by the parking lot & vehicle rental entities.
+An id is | 0 | 40 bits milliseconds since 2024-01-01 | 8 bits node | 15 bits sequence |, so ids are roughly ordered by
+creation time and generators on up to 256 nodes never collide. All the threads of a node take their ids from a single
+counter holding the timestamp & sequence, in blocks of BLOCK_SIZE so that the counter is touched once every BLOCK_SIZE
+ids. The counter never goes back, it jumps forward to the clock when the clock is ahead of it and simply runs on into
+the next millisecond when a millisecond's 32768 sequence numbers are used up, so ids stay unique even above 32M ids/s
+(the timestamp part is then a little ahead of the clock) or when the clock is set back. */
+class IdGenerator
+{
+    static const int SEQUENCE_BITS = 15;
+    static const int NODE_BITS = 8;
+    static const int64_t EPOCH_MILLIS = 1704067200000LL;  // 2024-01-01 00:00:00 UTC
+    static const uint64_t BLOCK_SIZE = 64;
+
+    /* Owned by serial rather than address, a generator created where a destroyed one lived must not take over its ids */
+    struct Block {
+        uint64_t owner;
+        uint64_t next;
+        uint64_t end;
+    };
+
+    static inline thread_local Block block = {};   // ids reserved by the current thread, [next, end)
+    static inline std::atomic<uint64_t> serials{0};
+
+    std::atomic<uint64_t> counter{0};   // milliseconds since the epoch << SEQUENCE_BITS | sequence
+    uint64_t serial;                    // unique per generator of the process, never 0
+    uint64_t nodeId = 0;
+
+    /* Coarse clock: a few milliseconds of resolution for a fraction of the cost of a precise clock read */
+    static int64_t getMillis() {
+        timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    }
+
+    void reserveBlock() {
+        uint64_t clock = (uint64_t)std::max<int64_t>(getMillis() - EPOCH_MILLIS, 0) << SEQUENCE_BITS;
+        uint64_t current = counter.load(std::memory_order_relaxed);
+        uint64_t start;
+        do {
+            start = std::max(current, clock);
+        } while (!counter.compare_exchange_weak(current, start + BLOCK_SIZE, std::memory_order_relaxed));
+
+        block.owner = serial;
+        block.next = start;
+        block.end = start + BLOCK_SIZE;
+    }
+
+public:
+    static const int MAX_NODES = 1 << NODE_BITS;
+
+    IdGenerator(int nodeId = 0) {
+        this->serial = serials.fetch_add(1, std::memory_order_relaxed) + 1;
+        setNodeId(nodeId);
+    }
+
+    static IdGenerator& getInstance() {
+        static IdGenerator generator;
+        return generator;
+    }
+
+    /* Every process generating ids for the same data needs its own node id, set it before generating any id */
+    void setNodeId(int nodeId) {
+        if (nodeId < 0 || nodeId >= MAX_NODES)
+            throw std::invalid_argument("node id must be between 0 and " + std::to_string(MAX_NODES - 1));
+        this->nodeId = nodeId;
+    }
+
+    int64_t nextId() {
+        if (block.owner != serial || block.next == block.end)
+            reserveBlock();
+
+        uint64_t value = block.next++;
+        uint64_t millis = value >> SEQUENCE_BITS;
+        uint64_t sequence = value & ((1ULL << SEQUENCE_BITS) - 1);
+        return (int64_t)(millis << (NODE_BITS + SEQUENCE_BITS) | nodeId << SEQUENCE_BITS | sequence);
+    }
+
+    /* Unix time in milliseconds at which the id was generated */
+    static int64_t getTimestampMillis(int64_t id) {
+        return (id >> (NODE_BITS + SEQUENCE_BITS)) + EPOCH_MILLIS;
+    }
+
+    static int getNodeId(int64_t id) {
+        return (id >> SEQUENCE_BITS) & (MAX_NODES - 1);
+    }
+};
@@ -1,4 +1,8 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "AllocationCounter.h"
 using namespace std;
 
 /* =========================================================== */
@@ -12,26 +16,442 @@ enum LogLevel
     DEBUG
 };
 
+const int LOG_LEVEL_COUNT = 3;
+
+/* Helper method to get the prefix printed in front of a record of given level */
+const char* getLogLevelName(LogLevel level)
+{
+    switch (level)
+    {
+        case LogLevel::INFO:
+            return "INFO";
+        case LogLevel::ERROR:
+            return "ERROR";
+        case LogLevel::DEBUG:
+            return "DEBUG";
+    }
+    return "UNKNOWN";
+}
+
+/* Severity of a level, the enum order is not the severity order so levels are compared through this */
+constexpr int getLogLevelSeverity(LogLevel level)
+{
+    return level == LogLevel::DEBUG ? 0 : (level == LogLevel::INFO ? 1 : 2);
+}
+
+/* Minimum level compiled into the binary, can be raised at build time with -DLOG_MIN_LEVEL=INFO.
+Logging calls below this level compile to nothing, plain log() calls at such a level are handled by no logger. */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL DEBUG
+#endif
+
+constexpr LogLevel MIN_LOG_LEVEL = LogLevel::LOG_MIN_LEVEL;
+
+constexpr bool isLogLevelEnabled(LogLevel level)
+{
+    return getLogLevelSeverity(level) >= getLogLevelSeverity(MIN_LOG_LEVEL);
+}
+
+/* =========================================================== */
+/* ===================== Message Formatting ================== */
+/* =========================================================== */
+
+/* Type erased argument of a format call. Arguments are captured as-is and only turned into text once we know
+the record is going to be written, and the formatting code itself does not have to be a template. */
+struct FormatArg
+{
+    enum Type { INT, UINT, DOUBLE, BOOL, CHAR, STRING, POINTER };
+
+    Type type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+    };
+    string_view s;
+};
+
+template <typename T>
+FormatArg makeFormatArg(const T &value)
+{
+    FormatArg arg;
+    if constexpr (is_same_v<T, bool>) {
+        arg.type = FormatArg::BOOL;
+        arg.u = value;
+    } else if constexpr (is_same_v<T, char>) {
+        arg.type = FormatArg::CHAR;
+        arg.u = (unsigned char)value;
+    } else if constexpr (is_enum_v<T>) {
+        arg.type = FormatArg::INT;
+        arg.i = (int64_t)value;
+    } else if constexpr (is_integral_v<T> && is_signed_v<T>) {
+        arg.type = FormatArg::INT;
+        arg.i = value;
+    } else if constexpr (is_integral_v<T>) {
+        arg.type = FormatArg::UINT;
+        arg.u = value;
+    } else if constexpr (is_floating_point_v<T>) {
+        arg.type = FormatArg::DOUBLE;
+        arg.d = value;
+    } else if constexpr (is_convertible_v<const T&, string_view>) {
+        arg.type = FormatArg::STRING;
+        arg.s = string_view(value);
+    } else if constexpr (is_pointer_v<T>) {
+        arg.type = FormatArg::POINTER;
+        arg.p = value;
+    } else {
+        static_assert(is_pointer_v<T>, "unsupported log argument type");
+    }
+    return arg;
+}
+
+/* Appends a single argument to the output, numbers are converted with to_chars so nothing gets allocated */
+void appendFormatArg(string &out, const FormatArg &arg)
+{
+    char buffer[32];
+    to_chars_result result = {buffer, errc()};
+    switch (arg.type)
+    {
+        case FormatArg::INT:
+            result = to_chars(buffer, buffer + sizeof(buffer), arg.i);
+            break;
+        case FormatArg::UINT:
+            result = to_chars(buffer, buffer + sizeof(buffer), arg.u);
+            break;
+        case FormatArg::DOUBLE:
+            result = to_chars(buffer, buffer + sizeof(buffer), arg.d);
+            break;
+        case FormatArg::BOOL:
+            out.append(arg.u ? "true" : "false");
+            return;
+        case FormatArg::CHAR:
+            out.push_back((char)arg.u);
+            return;
+        case FormatArg::STRING:
+            out.append(arg.s);
+            return;
+        case FormatArg::POINTER:
+            buffer[0] = '0';
+            buffer[1] = 'x';
+            result = to_chars(buffer + 2, buffer + sizeof(buffer), (uintptr_t)arg.p, 16);
+            break;
+    }
+    out.append(buffer, result.ptr - buffer);
+}
+
+/* Replaces every {} in the format string with the next argument, {{ and }} print literal braces */
+void formatArgsTo(string &out, string_view fmt, const FormatArg *args, size_t count)
+{
+    size_t next = 0;
+    for (size_t i=0; i<fmt.size(); i++) {
+        char c = fmt[i];
+        if (c == '{' && i + 1 < fmt.size() && fmt[i+1] == '}' && next < count) {
+            appendFormatArg(out, args[next++]);
+            i++;
+        } else if ((c == '{' || c == '}') && i + 1 < fmt.size() && fmt[i+1] == c) {
+            out.push_back(c);
+            i++;
+        } else {
+            out.push_back(c);
+        }
+    }
+}
+
+/* Keeps every format string used by a call site under a small numeric id, so that binary records can refer to
+the format string by its id instead of carrying the text. Call sites register once, see the LOG_* macros. */
+class LogFormatRegistry
+{
+    mutex registryMutex;
+    vector<string> formats;
+    unordered_map<string, uint32_t> ids;
+
+    LogFormatRegistry() {}
+    LogFormatRegistry(const LogFormatRegistry &) {}
+    static LogFormatRegistry* instance;
+
+public:
+    static const uint32_t UNREGISTERED = UINT32_MAX;
+
+    static LogFormatRegistry* getInstance() {
+        return instance;
+    }
+
+    uint32_t registerFormat(string_view fmt) {
+        lock_guard<mutex> lock(registryMutex);
+        auto it = ids.find(string(fmt));
+        if (it != ids.end())
+            return it->second;
+
+        uint32_t id = formats.size();
+        formats.push_back(string(fmt));
+        ids[formats.back()] = id;
+        return id;
+    }
+};
+
+/* created eagerly so that call sites on different threads can register without racing on the instance */
+LogFormatRegistry* LogFormatRegistry::instance = new LogFormatRegistry();
+
+/* Counter split over cache line sized shards, so that threads logging at the same time don't fight over one line */
+class ShardedCounter
+{
+    static const int SHARDS = 16;
+
+    struct alignas(64) Shard {
+        atomic<uint64_t> value{0};
+    };
+
+    Shard shards[SHARDS];
+
+    static int getShard() {
+        thread_local int shard = hash<thread::id>()(this_thread::get_id()) % SHARDS;
+        return shard;
+    }
+
+public:
+    void add(uint64_t value) {
+        shards[getShard()].value.fetch_add(value, memory_order_relaxed);
+    }
+
+    uint64_t get() {
+        uint64_t total = 0;
+        for (int i=0; i<SHARDS; i++)
+            total += shards[i].value.load(memory_order_relaxed);
+        return total;
+    }
+};
+
+/* Counters of the logging system which can be read at runtime, to tell when logging starts to dominate a request.
+Records emitted and time spent in the sink are counted by the loggers, bytes by the sinks when they hand the bytes
+to the OS and drops by whoever drops the record. */
+class LogMetrics
+{
+    ShardedCounter recordsEmitted;
+    ShardedCounter recordsDropped;
+    ShardedCounter bytesWritten;
+    ShardedCounter sinkNanos;
+    atomic<bool> timingEnabled{true};
+
+    LogMetrics() {}
+    LogMetrics(const LogMetrics &) {}
+    static LogMetrics* instance;
+
+public:
+    struct Snapshot {
+        uint64_t recordsEmitted;
+        uint64_t recordsDropped;
+        uint64_t bytesWritten;
+        uint64_t sinkNanos;
+    };
+
+    static LogMetrics* getInstance() {
+        return instance;
+    }
+
+    /* Reading the clock twice per record would cost more than a fast sink itself, so only one in TIMING_SAMPLE_RATE
+    records of a thread is timed and the time spent in the sink is extrapolated from those */
+    static const uint64_t TIMING_SAMPLE_RATE = 64;
+
+    void setTimingEnabled(bool enabled) {
+        timingEnabled.store(enabled, memory_order_relaxed);
+    }
+
+    uint64_t startTimer() {
+        thread_local uint64_t records = 0;
+        if (++records % TIMING_SAMPLE_RATE != 0 || !timingEnabled.load(memory_order_relaxed))
+            return 0;
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void recordEmitted(uint64_t startedAt) {
+        recordsEmitted.add(1);
+        if (startedAt != 0) {
+            uint64_t now = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+            sinkNanos.add((now - startedAt) * TIMING_SAMPLE_RATE);
+        }
+    }
+
+    void recordDropped() {
+        recordsDropped.add(1);
+    }
+
+    void recordBytes(uint64_t bytes) {
+        bytesWritten.add(bytes);
+    }
+
+    Snapshot getSnapshot() {
+        return {recordsEmitted.get(), recordsDropped.get(), bytesWritten.get(), sinkNanos.get()};
+    }
+
+    void print(ostream &out) {
+        Snapshot snapshot = getSnapshot();
+        out << "records emitted: " << snapshot.recordsEmitted << ", dropped: " << snapshot.recordsDropped
+            << ", bytes written: " << snapshot.bytesWritten << ", time in sink: " << snapshot.sinkNanos / 1000 << "us" << endl;
+    }
+};
+
+LogMetrics* LogMetrics::instance = new LogMetrics();
+
+/* Sink is the destination where a logger finally writes its records. Keeping it separate from the chain
+lets us swap the synchronous console output with a buffered / asynchronous one without touching the loggers. */
+class LogSink
+{
+public:
+    /* Returns false when the sink dropped a record instead of taking this one, so that the loggers only count the
+    records which got through as emitted */
+    virtual bool write(LogLevel level, string_view msg) = 0;
+
+    /* Writes a record which has not been formatted yet. Text sinks format it here, binary sinks store the
+    format id and the raw arguments instead. */
+    virtual bool writeArgs(LogLevel level, uint32_t /* formatId */, string_view fmt, const FormatArg *args, size_t count) {
+        thread_local string buffer;
+        buffer.clear();
+        formatArgsTo(buffer, fmt, args, count);
+        return write(level, buffer);
+    }
+
+    virtual void flush() {}
+    virtual ~LogSink() {}
+};
+
+/* Default sink which writes every record to the console on the calling thread. We are using singleton design pattern
+as there is only one console to write to. */
+class ConsoleSink: public LogSink
+{
+    ConsoleSink() {}
+    ConsoleSink(const ConsoleSink &) {}
+    static ConsoleSink* instance;
+
+public:
+    static ConsoleSink* getInstance();
+
+    bool write(LogLevel level, string_view msg) {
+        const char *name = getLogLevelName(level);
+        cout << name << ": " << msg << endl;
+        LogMetrics::getInstance()->recordBytes(strlen(name) + 2 + msg.size() + 1);
+        return true;
+    }
+
+    void flush() {
+        cout.flush();
+    }
+};
+
+ConsoleSink* ConsoleSink::instance = NULL;
+
+ConsoleSink* ConsoleSink::getInstance()
+{
+    if (instance == NULL)
+        instance = new ConsoleSink();
+
+    return instance;
+}
+
+/* Sink which writes text records to any output stream, it does not flush after every record like the console does */
+class StreamSink: public LogSink
+{
+    ostream &out;
+
+public:
+    StreamSink(ostream &out): out(out) {}
+
+    bool write(LogLevel level, string_view msg) {
+        const char *name = getLogLevelName(level);
+        out << name << ": " << msg << '\n';
+        LogMetrics::getInstance()->recordBytes(strlen(name) + 2 + msg.size() + 1);
+        return true;
+    }
+
+    void flush() {
+        out.flush();
+    }
+};
+
+/* Loggers form a chain of responsibility, a record is passed down the chain till a logger which can handle its level
+is found. Messages travel as string_view so that passing a record down the chain never copies it. */
 class Logger {
     Logger *nextLogger = NULL;
 
+protected:
+    LogSink *sink;
+
 public:
-    Logger(Logger *nextLogger) {
+    Logger(Logger *nextLogger, LogSink *sink) {
         this->nextLogger = nextLogger;
+        this->sink = sink;
+    }
+
+    virtual ~Logger() {}
+
+    Logger* getNextLogger() {
+        return nextLogger;
+    }
+
+    virtual bool canHandle(LogLevel) {
+        return false;
+    }
+
+    /* Writes the record handled by this logger to its sink */
+    virtual void write(LogLevel level, string_view msg) {
+        LogMetrics *metrics = LogMetrics::getInstance();
+        uint64_t startedAt = metrics->startTimer();
+        if (sink->write(level, msg))
+            metrics->recordEmitted(startedAt);
+    }
+
+    virtual void writeArgs(LogLevel level, uint32_t formatId, string_view fmt, const FormatArg *args, size_t count) {
+        LogMetrics *metrics = LogMetrics::getInstance();
+        uint64_t startedAt = metrics->startTimer();
+        if (sink->writeArgs(level, formatId, fmt, args, count))
+            metrics->recordEmitted(startedAt);
     }
-    
-    virtual void log(LogLevel level, string msg) {
-        if (nextLogger != NULL)
+
+    /* Passes the record down the chain. Levels below MIN_LOG_LEVEL are handled by nobody & stop here. */
+    virtual void log(LogLevel level, string_view msg) {
+        if (nextLogger != NULL && isLogLevelEnabled(level))
             nextLogger->log(level, msg);
     }
+
+    /* Returns the first logger in the chain starting here which handles the level, NULL if nobody does */
+    Logger* findHandler(LogLevel level) {
+        for (Logger *logger = this; logger != NULL; logger = logger->nextLogger) {
+            if (logger->canHandle(level))
+                return logger;
+        }
+        return NULL;
+    }
+
+    /* Lazily formatted logging, the arguments are captured as they are and the message is built by the sink only
+    after a handler for the level has been found. Levels below MIN_LOG_LEVEL compile to nothing. */
+    template <LogLevel level, typename... Args>
+    void logf(uint32_t formatId, string_view fmt, const Args&... args) {
+        if constexpr (isLogLevelEnabled(level)) {
+            Logger *handler = findHandler(level);
+            if (handler == NULL)
+                return;
+
+            FormatArg formatArgs[sizeof...(Args) + 1] = {makeFormatArg(args)...};
+            handler->writeArgs(level, formatId, fmt, formatArgs, sizeof...(Args));
+        }
+    }
+
+    template <LogLevel level, typename... Args>
+    void logf(string_view fmt, const Args&... args) {
+        logf<level>(LogFormatRegistry::UNREGISTERED, fmt, args...);
+    }
 };
 
 class InfoLogger: public Logger {
 public:
-    InfoLogger(Logger *nextLogger): Logger(nextLogger) {};
-    void log(LogLevel level, string msg) {
-        if (level == LogLevel::INFO) {
-            cout << "INFO: " << msg << endl;
+    InfoLogger(Logger *nextLogger, LogSink *sink = ConsoleSink::getInstance()): Logger(nextLogger, sink) {};
+    bool canHandle(LogLevel level) {
+        return isLogLevelEnabled(level) && level == LogLevel::INFO;
+    }
+
+    void log(LogLevel level, string_view msg) {
+        if (canHandle(level)) {
+            write(level, msg);
         } else {
             Logger::log(level, msg);
         }
@@ -40,10 +460,14 @@ public:
 
 class DebugLogger: public Logger {
 public:
-    DebugLogger(Logger *nextLogger): Logger(nextLogger) {};
-    void log(LogLevel level, string msg) {
-        if (level == LogLevel::DEBUG) {
-            cout << "DEBUG: " << msg << endl;
+    DebugLogger(Logger *nextLogger, LogSink *sink = ConsoleSink::getInstance()): Logger(nextLogger, sink) {};
+    bool canHandle(LogLevel level) {
+        return isLogLevelEnabled(level) && level == LogLevel::DEBUG;
+    }
+
+    void log(LogLevel level, string_view msg) {
+        if (canHandle(level)) {
+            write(level, msg);
         } else {
             Logger::log(level, msg);
         }
@@ -52,24 +476,1807 @@ public:
 
 class ErrorLogger: public Logger {
 public:
-    ErrorLogger(Logger *nextLogger): Logger(nextLogger) {};
-    void log(LogLevel level, string msg) {
-        if (level == LogLevel::ERROR) {
-            cout << "ERROR: " << msg << endl;
+    ErrorLogger(Logger *nextLogger, LogSink *sink = ConsoleSink::getInstance()): Logger(nextLogger, sink) {};
+    bool canHandle(LogLevel level) {
+        return isLogLevelEnabled(level) && level == LogLevel::ERROR;
+    }
+
+    void log(LogLevel level, string_view msg) {
+        if (canHandle(level)) {
+            write(level, msg);
         } else {
             Logger::log(level, msg);
         }
     }
 };
 
-/* Driver function */
-int main()
+/* Compiles a chain of loggers into a per level handler table, so that dispatching a record is a single indexed lookup
+and one call instead of a walk down the chain. The chain is still built the usual way and the first logger in the
+chain which can handle a level owns it, exactly as the walk would have found it. */
+class LogDispatcher
 {
-    Logger *logger = new InfoLogger(new DebugLogger(new ErrorLogger(NULL)));
-    
-    logger->log(LogLevel::ERROR, "something went wrong!");
-    logger->log(LogLevel::INFO, "new day, new challenges");
-    logger->log(LogLevel::DEBUG, "debugging is fun if you understand the code.");
+    Logger* handlers[LOG_LEVEL_COUNT];
+
+public:
+    LogDispatcher(Logger *chain) {
+        compile(chain);
+    }
+
+    /* Re-builds the handler table, has to be called again if the chain is modified. Levels below MIN_LOG_LEVEL
+    get no handler so that they are dropped by the plain log() call as well. */
+    void compile(Logger *chain) {
+        for (int level=0; level<LOG_LEVEL_COUNT; level++) {
+            handlers[level] = NULL;
+            if (chain != NULL && isLogLevelEnabled((LogLevel)level))
+                handlers[level] = chain->findHandler((LogLevel)level);
+        }
+    }
+
+    /* Checks if a record of given level would be written by anyone, so that callers can skip building it */
+    bool isEnabled(LogLevel level) {
+        return handlers[level] != NULL;
+    }
+
+    void log(LogLevel level, string_view msg) {
+        Logger *handler = handlers[level];
+        if (handler != NULL)
+            handler->write(level, msg);
+    }
+
+    /* Lazily formatted logging, see Logger::logf */
+    template <LogLevel level, typename... Args>
+    void logf(uint32_t formatId, string_view fmt, const Args&... args) {
+        if constexpr (isLogLevelEnabled(level)) {
+            Logger *handler = handlers[level];
+            if (handler == NULL)
+                return;
+
+            FormatArg formatArgs[sizeof...(Args) + 1] = {makeFormatArg(args)...};
+            handler->writeArgs(level, formatId, fmt, formatArgs, sizeof...(Args));
+        }
+    }
+
+    template <LogLevel level, typename... Args>
+    void logf(string_view fmt, const Args&... args) {
+        logf<level>(LogFormatRegistry::UNREGISTERED, fmt, args...);
+    }
+};
+
+/* Call site macros for a Logger or a LogDispatcher, the first argument after the logger is the format string.
+Every call site registers its format string once. When the level is compiled out even the arguments are not evaluated. */
+#define LOG_FORMAT_STRING(fmt, ...) fmt
+#define LOG_AT_LEVEL(logger, level, ...) do { \
+        if constexpr (isLogLevelEnabled(level)) { \
+            static const uint32_t logFormatId = LogFormatRegistry::getInstance()->registerFormat(LOG_FORMAT_STRING(__VA_ARGS__, "")); \
+            (logger).logf<level>(logFormatId, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_INFO(logger, ...) LOG_AT_LEVEL(logger, LogLevel::INFO, __VA_ARGS__)
+#define LOG_ERROR(logger, ...) LOG_AT_LEVEL(logger, LogLevel::ERROR, __VA_ARGS__)
+#define LOG_DEBUG(logger, ...) LOG_AT_LEVEL(logger, LogLevel::DEBUG, __VA_ARGS__)
+
+/* =========================================================== */
+/* ================= Sampling & Rate Limiting ================ */
+/* =========================================================== */
+
+/* Token bucket implemented as GCRA (generic cell rate algorithm): the whole state is the theoretical arrival time of
+the next token, so taking a token is a single CAS and never takes a lock. A rate of 0 means unlimited. */
+class TokenBucket
+{
+    atomic<uint64_t> theoreticalArrival{0};
+    uint64_t emissionInterval = 0;      // nanoseconds per token
+    uint64_t burstTolerance = 0;        // how far ahead of time the bucket may run, i.e. the burst size
+
+public:
+    void configure(double ratePerSecond, uint32_t burst) {
+        emissionInterval = ratePerSecond > 0 ? (uint64_t)(1e9 / ratePerSecond) : 0;
+        burstTolerance = emissionInterval * (burst > 0 ? burst - 1 : 0);
+    }
+
+    bool tryAcquire(uint64_t now) {
+        if (emissionInterval == 0)
+            return true;
+
+        uint64_t arrival = theoreticalArrival.load(memory_order_relaxed);
+        while (true) {
+            uint64_t start = max(arrival, now);
+            if (start - now > burstTolerance)
+                return false;
+            if (theoreticalArrival.compare_exchange_weak(arrival, start + emissionInterval, memory_order_relaxed))
+                return true;
+        }
+    }
+};
+
+struct RateLimitConfig
+{
+    double levelRate[LOG_LEVEL_COUNT] = {0, 0, 0};          // records per second for each level, 0 means unlimited
+    uint32_t levelBurst[LOG_LEVEL_COUNT] = {1, 1, 1};
+    double siteRate = 0;                                    // records per second for each call site, 0 means unlimited
+    uint32_t siteBurst = 1;
+    double sampleRate[LOG_LEVEL_COUNT] = {1, 1, 1};         // fraction of records kept after rate limiting
+    chrono::milliseconds dedupWindow{0};                    // identical records within the window are suppressed
+};
+
+/* Stage which sits in the chain in front of the handlers and lets through only part of the records: per level and
+per call site token buckets, probabilistic sampling and suppression of identical records within a time window.
+Suppressed duplicates are reported as "suppressed N similar" once the window is over, by the next repeat of the record
+or else by the next record let through at all: a background sweeper checks the windows a few times per window & sets
+aside what the ones which are over suppressed, but never writes itself, so the sinks only see the logging threads.
+Dropping a record never allocates or takes a lock, all the state lives in fixed size tables of atomics. */
+class RateLimitingLogger: public Logger
+{
+    static const size_t TABLE_SIZE = 1024;
+
+    /* Recently seen record, slots are picked by hash so unrelated records sharing a slot simply evict each other */
+    struct DedupSlot {
+        atomic<uint64_t> hash{0};
+        atomic<uint64_t> windowEnd{0};
+        atomic<uint32_t> suppressed{0};
+        atomic<uint32_t> expired{0};    // suppressed in windows which are over, not reported yet
+        atomic<int> level{LogLevel::INFO};
+    };
+
+    RateLimitConfig config;
+    bool limited[LOG_LEVEL_COUNT];
+    Logger* handlers[LOG_LEVEL_COUNT];      // handler of each level in the rest of the chain
+    uint64_t sampleThreshold[LOG_LEVEL_COUNT];
+    TokenBucket levelBuckets[LOG_LEVEL_COUNT];
+    unique_ptr<TokenBucket[]> siteBuckets;
+    unique_ptr<DedupSlot[]> dedupSlots;
+    atomic<uint64_t> dropped{0};
+    atomic<bool> hasExpired{false};     // a slot has expired duplicates
+
+    bool stopping = false;
+    mutex sweeperMutex;
+    condition_variable wakeSweeper;
+    thread sweeper;             // only runs with a dedup window
+
+    static uint64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t nextRandom() {
+        thread_local uint64_t state = hash<thread::id>()(this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    static uint64_t mixHash(uint64_t seed, uint64_t value) {
+        seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+
+    /* Returns the number of duplicates suppressed in the previous window if the record starts a new window,
+    0 if it starts one with nothing suppressed and -1 if the record is a duplicate to be dropped */
+    long long checkDuplicate(LogLevel level, uint64_t hash, uint64_t now) {
+        if (config.dedupWindow.count() == 0)
+            return 0;
+
+        DedupSlot &slot = dedupSlots[hash % TABLE_SIZE];
+        if (slot.hash.load(memory_order_relaxed) == hash && now < slot.windowEnd.load(memory_order_relaxed)) {
+            slot.suppressed.fetch_add(1, memory_order_relaxed);
+            return -1;
+        }
+
+        uint64_t previousHash = slot.hash.exchange(hash, memory_order_relaxed);
+        LogLevel previousLevel = (LogLevel)slot.level.exchange(level, memory_order_relaxed);
+        slot.windowEnd.store(now + chrono::duration_cast<chrono::nanoseconds>(config.dedupWindow).count(), memory_order_relaxed);
+        uint32_t suppressed = slot.suppressed.exchange(0, memory_order_relaxed) + slot.expired.exchange(0, memory_order_relaxed);
+        if (suppressed > 0 && previousHash != hash) {
+            // the slot was taken over, report what the previous record had suppressed on its own
+            emitSummary(previousLevel, suppressed);
+            return 0;
+        }
+        return suppressed;
+    }
+
+    /* siteBucket is NULL for records without a call site */
+    bool admit(LogLevel level, TokenBucket *siteBucket, uint64_t now) {
+        if (!levelBuckets[level].tryAcquire(now))
+            return false;
+        if (siteBucket != NULL && config.siteRate > 0 && !siteBucket->tryAcquire(now))
+            return false;
+        if (sampleThreshold[level] != UINT64_MAX && nextRandom() > sampleThreshold[level])
+            return false;
+        return true;
+    }
+
+    void emitSummary(LogLevel level, uint32_t suppressed) {
+        if (handlers[level] != NULL)
+            handlers[level]->write(level, "suppressed " + to_string(suppressed) + " similar messages");
+    }
+
+    /* Reports what the sweeper set aside, from the thread of a record let through */
+    void emitExpired() {
+        if (!hasExpired.exchange(false, memory_order_acquire))
+            return;
+        for (size_t i=0; i<TABLE_SIZE; i++) {
+            uint32_t suppressed = dedupSlots[i].expired.exchange(0, memory_order_relaxed);
+            if (suppressed > 0)
+                emitSummary((LogLevel)dedupSlots[i].level.load(memory_order_relaxed), suppressed);
+        }
+    }
+
+    /* Sets aside the duplicates of the windows which are over, whether the record came back or not */
+    void runSweeper() {
+        auto interval = max(chrono::duration_cast<chrono::milliseconds>(config.dedupWindow / 4), chrono::milliseconds(1));
+        unique_lock<mutex> lock(sweeperMutex);
+        while (!stopping) {
+            wakeSweeper.wait_for(lock, interval);
+            uint64_t time = now();
+            for (size_t i=0; i<TABLE_SIZE; i++) {
+                DedupSlot &slot = dedupSlots[i];
+                if (slot.suppressed.load(memory_order_relaxed) == 0 || time < slot.windowEnd.load(memory_order_relaxed))
+                    continue;
+                uint32_t suppressed = slot.suppressed.exchange(0, memory_order_relaxed);
+                if (suppressed > 0) {
+                    slot.expired.fetch_add(suppressed, memory_order_relaxed);
+                    hasExpired.store(true, memory_order_release);
+                }
+            }
+        }
+    }
+
+public:
+    RateLimitingLogger(Logger *nextLogger, RateLimitConfig config): Logger(nextLogger, NULL) {
+        this->config = config;
+        this->siteBuckets.reset(new TokenBucket[TABLE_SIZE]);
+        this->dedupSlots.reset(new DedupSlot[TABLE_SIZE]);
+
+        for (int level=0; level<LOG_LEVEL_COUNT; level++) {
+            levelBuckets[level].configure(config.levelRate[level], config.levelBurst[level]);
+            sampleThreshold[level] = config.sampleRate[level] >= 1 ? UINT64_MAX : (uint64_t)(config.sampleRate[level] * (double)UINT64_MAX);
+            limited[level] = config.levelRate[level] > 0 || config.siteRate > 0 || config.sampleRate[level] < 1 || config.dedupWindow.count() > 0;
+            handlers[level] = nextLogger != NULL ? nextLogger->findHandler((LogLevel)level) : NULL;
+        }
+        for (size_t i=0; i<TABLE_SIZE; i++)
+            siteBuckets[i].configure(config.siteRate, config.siteBurst);
+        if (config.dedupWindow.count() > 0)
+            sweeper = thread(&RateLimitingLogger::runSweeper, this);
+    }
+
+    ~RateLimitingLogger() {
+        if (sweeper.joinable()) {
+            {
+                lock_guard<mutex> lock(sweeperMutex);
+                stopping = true;
+                wakeSweeper.notify_one();
+            }
+            sweeper.join();
+        }
+    }
+
+    bool canHandle(LogLevel level) {
+        return isLogLevelEnabled(level) && limited[level] && handlers[level] != NULL;
+    }
+
+    void log(LogLevel level, string_view msg) {
+        if (canHandle(level)) {
+            write(level, msg);
+        } else {
+            Logger::log(level, msg);
+        }
+    }
+
+    /* Plain text records have no call site, the level bucket & sampling apply to them but no site bucket */
+    void write(LogLevel level, string_view msg) {
+        uint64_t time = now();
+        long long suppressed = checkDuplicate(level, mixHash(level, hash<string_view>()(msg)), time);
+        if (suppressed < 0 || !admit(level, NULL, time)) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            LogMetrics::getInstance()->recordDropped();
+            return;
+        }
+
+        handlers[level]->write(level, msg);
+        if (suppressed > 0)
+            emitSummary(level, suppressed);
+        if (hasExpired.load(memory_order_relaxed))
+            emitExpired();
+    }
+
+    /* Call site is identified by the format id, duplicates by the format id and the argument values. Records are
+    dropped before they are ever formatted. */
+    void writeArgs(LogLevel level, uint32_t formatId, string_view fmt, const FormatArg *args, size_t count) {
+        uint64_t site = formatId != LogFormatRegistry::UNREGISTERED ? formatId : (uintptr_t)fmt.data();
+        uint64_t time = now();
+
+        long long suppressed = 0;
+        if (config.dedupWindow.count() > 0) {
+            uint64_t recordHash = mixHash(level, site);
+            for (size_t i=0; i<count; i++)
+                recordHash = mixHash(recordHash, args[i].type == FormatArg::STRING ? hash<string_view>()(args[i].s) : args[i].u);
+            suppressed = checkDuplicate(level, recordHash, time);
+        }
+
+        if (suppressed < 0 || !admit(level, &siteBuckets[site % TABLE_SIZE], time)) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            LogMetrics::getInstance()->recordDropped();
+            return;
+        }
+
+        handlers[level]->writeArgs(level, formatId, fmt, args, count);
+        if (suppressed > 0)
+            emitSummary(level, suppressed);
+        if (hasExpired.load(memory_order_relaxed))
+            emitExpired();
+    }
+
+    /* Reports duplicates suppressed in windows which are not over yet & what the sweeper set aside */
+    void flushSuppressed() {
+        emitExpired();
+        for (size_t i=0; i<TABLE_SIZE; i++) {
+            uint32_t suppressed = dedupSlots[i].suppressed.exchange(0, memory_order_relaxed);
+            if (suppressed > 0)
+                emitSummary((LogLevel)dedupSlots[i].level.load(memory_order_relaxed), suppressed);
+        }
+    }
+
+    uint64_t getDroppedCount() {
+        return dropped.load(memory_order_relaxed);
+    }
+};
+
+/* =========================================================== */
+/* ================= Asynchronous Log Backend ================ */
+/* =========================================================== */
+
+/* What a producer should do when the ring is full */
+enum OverflowPolicy
+{
+    BLOCK,          // wait until the writer thread frees up a cell
+    DROP_NEWEST,    // discard the record being logged
+    DROP_OLDEST     // discard the oldest queued record to make room
+};
+
+/* A single record as stored in the ring. Text is kept inline (truncated if longer) so that producers never allocate. */
+struct LogRecord
+{
+    static constexpr size_t MAX_TEXT_LENGTH = 248;
+
+    LogLevel level;
+    uint32_t length;
+    char text[MAX_TEXT_LENGTH];
+};
+
+/* Bounded lock-free multi-producer multi-consumer ring (Vyukov's bounded queue). Each cell carries a sequence number
+which tells a producer whether the cell is free to be written and a consumer whether it is ready to be read. */
+template <typename T>
+class BoundedRing
+{
+    struct Cell {
+        atomic<size_t> sequence;
+        T data;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos;
+    alignas(64) atomic<size_t> dequeuePos;
+
+public:
+    BoundedRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        this->cells.reset(new Cell[size]);
+        this->mask = size - 1;
+        for (size_t i=0; i<size; i++)
+            cells[i].sequence.store(i, memory_order_relaxed);
+
+        enqueuePos.store(0, memory_order_relaxed);
+        dequeuePos.store(0, memory_order_relaxed);
+    }
+
+    /* Reserves a cell and lets the caller fill it in place. Returns false if the ring is full. */
+    template <typename Fill>
+    bool tryPush(Fill fill) {
+        Cell *cell;
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+
+        fill(cell->data);
+        cell->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    /* Hands the oldest published record to the caller. Returns false if there is nothing to read. */
+    template <typename Consume>
+    bool tryPop(Consume consume) {
+        Cell *cell;
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+
+        consume(cell->data);
+        cell->sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+
+    /* True if the next cell to be read has already been published by its producer */
+    bool hasPending() {
+        size_t pos = dequeuePos.load(memory_order_acquire);
+        return cells[pos & mask].sequence.load(memory_order_acquire) == pos + 1;
+    }
+
+    /* Number of cells reserved by producers so far */
+    size_t getEnqueued() {
+        return enqueuePos.load(memory_order_acquire);
+    }
+};
+
+/* Sink which moves the console / file I/O off the calling thread. Producers copy the record into a lock-free ring and
+return immediately, a single background writer drains the ring, formats the records and writes them out in batches. */
+class AsyncLogSink: public LogSink
+{
+    static const size_t BATCH_SIZE = 256;
+
+    ostream &out;
+    OverflowPolicy policy;
+    BoundedRing<LogRecord> ring;
+
+    atomic<uint64_t> retired{0};   // records written out by the writer or discarded to make room
+    atomic<uint64_t> dropped{0};
+    atomic<bool> stopping{false};
+    atomic<int> activeProducers{0};   // inside write(), the writer doesn't stop while any is
+    atomic<bool> writerIdle{false};
+    atomic<int> flushWaiters{0};
+
+    mutex stateMutex;
+    condition_variable wakeWriter;
+    condition_variable batchWritten;
+    thread writer;
+
+    void wakeUpWriter() {
+        if (writerIdle.load()) {
+            lock_guard<mutex> lock(stateMutex);
+            wakeWriter.notify_one();
+        }
+    }
+
+    void run() {
+        string batch;
+        batch.reserve(BATCH_SIZE * 64);
+
+        while (true)
+        {
+            size_t count = 0;
+            while (count < BATCH_SIZE && ring.tryPop([&](LogRecord &record) {
+                batch.append(getLogLevelName(record.level));
+                batch.append(": ");
+                batch.append(record.text, record.length);
+                batch.push_back('\n');
+            })) {
+                count++;
+            }
+
+            if (count > 0) {
+                out.write(batch.data(), batch.size());
+                out.flush();
+                LogMetrics::getInstance()->recordBytes(batch.size());
+                batch.clear();
+
+                retired.fetch_add(count);
+                if (flushWaiters.load() > 0) {
+                    lock_guard<mutex> lock(stateMutex);
+                    batchWritten.notify_all();
+                }
+                continue;
+            }
+
+            unique_lock<mutex> lock(stateMutex);
+            writerIdle.store(true);
+            // checked before the ring: once stopping & no producer is left, whatever was pushed is visible
+            bool isStopped = stopping.load() && activeProducers.load() == 0;
+            if (!ring.hasPending()) {
+                if (isStopped)
+                    break;
+                wakeWriter.wait_for(lock, chrono::milliseconds(10));
+            }
+            writerIdle.store(false);
+        }
+    }
+
+public:
+    AsyncLogSink(ostream &out, size_t capacity, OverflowPolicy policy): out(out), ring(capacity) {
+        this->policy = policy;
+        this->writer = thread(&AsyncLogSink::run, this);
+    }
+
+    ~AsyncLogSink() {
+        shutdown();
+    }
+
+    bool write(LogLevel level, string_view msg) {
+        // registered before checking stopping, so either shutdown sees this producer & waits for its record or the
+        // producer sees stopping & drops the record
+        activeProducers.fetch_add(1);
+        bool accepted = pushRecord(level, msg);
+        activeProducers.fetch_sub(1);
+        wakeUpWriter();
+        return accepted;
+    }
+
+private:
+    /* Returns false when this record or, with DROP_OLDEST, an older one it pushed out was dropped */
+    bool pushRecord(LogLevel level, string_view msg) {
+        if (stopping.load()) {
+            dropped.fetch_add(1);
+            LogMetrics::getInstance()->recordDropped();
+            return false;
+        }
+
+        auto fill = [&](LogRecord &record) {
+            record.level = level;
+            record.length = min(msg.size(), LogRecord::MAX_TEXT_LENGTH);
+            memcpy(record.text, msg.data(), record.length);
+        };
+
+        bool accepted = true;
+        while (!ring.tryPush(fill))
+        {
+            if (policy == OverflowPolicy::DROP_NEWEST) {
+                dropped.fetch_add(1);
+                LogMetrics::getInstance()->recordDropped();
+                return false;
+            }
+
+            if (policy == OverflowPolicy::DROP_OLDEST) {
+                if (ring.tryPop([](LogRecord &) {})) {
+                    dropped.fetch_add(1);
+                    LogMetrics::getInstance()->recordDropped();
+                    retired.fetch_add(1);
+                    accepted = false;
+                }
+                continue;
+            }
+
+            wakeUpWriter();
+            this_thread::yield();
+        }
+        return accepted;
+    }
+
+public:
+    /* Barrier: returns once every record logged before this call has been written out (or dropped) */
+    void flush() {
+        uint64_t target = ring.getEnqueued();
+        flushWaiters.fetch_add(1);
+        wakeUpWriter();
+        {
+            unique_lock<mutex> lock(stateMutex);
+            while (retired.load() < target)
+                batchWritten.wait_for(lock, chrono::milliseconds(1));
+        }
+        flushWaiters.fetch_sub(1);
+    }
+
+    /* Drains the ring and stops the writer thread. Records logged after shutdown are dropped. */
+    void shutdown() {
+        if (stopping.load())
+            return;
+
+        flush();
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping.store(true);
+            wakeWriter.notify_one();
+        }
+        if (writer.joinable())
+            writer.join();
+    }
+
+    uint64_t getDroppedCount() {
+        return dropped.load();
+    }
+};
+
+/* =========================================================== */
+/* ================== Per Thread Log Buffers ================= */
+/* =========================================================== */
+
+/* Log buffer owned by a single producer thread. It is a single-producer single-consumer ring, so the owning thread and
+the merger never contend on anything but the head / tail of this one ring. */
+struct ThreadLogBuffer
+{
+    static const uint64_t IDLE = UINT64_MAX;
+
+    struct Entry {
+        uint64_t timestamp;
+        LogRecord record;
+    };
+
+    unique_ptr<Entry[]> entries;
+    size_t capacity;
+    alignas(64) atomic<size_t> head{0};         // next entry to be read by the merger
+    alignas(64) atomic<size_t> tail{0};         // next entry to be written by the owner
+    atomic<uint64_t> inFlight{IDLE};            // lower bound on the timestamp of a record being written right now
+    uint64_t lastTimestamp = 0;
+    atomic<bool> owned{true};
+
+    ThreadLogBuffer(size_t capacity) {
+        this->capacity = capacity;
+        this->entries.reset(new Entry[capacity]);
+    }
+};
+
+/* Sink which gives every producer thread its own buffer so that logging threads never share a lock or a cache line.
+A merger thread drains all the buffers and writes the records out in timestamp order. A record is only written once
+no other thread can still publish an older one, for that each producer advertises a lower bound on the timestamp of
+the record it is in the middle of writing. */
+class PerThreadLogSink: public LogSink
+{
+    static const int MAX_THREADS = 256;
+    static atomic<uint64_t> nextSinkId;
+
+    ostream &out;
+    size_t bufferCapacity;
+    bool printTimestamps;
+    uint64_t sinkId;
+
+    mutex registryMutex;
+    shared_ptr<ThreadLogBuffer> buffers[MAX_THREADS];
+    atomic<int> bufferCount{0};
+
+    atomic<uint64_t> completedWatermark{0};     // every record older than this has been written out
+    atomic<bool> stopping{false};
+    mutex stateMutex;
+    condition_variable wakeMerger;
+    condition_variable roundCompleted;
+    thread merger;
+
+    /* Buffers of the threads which have used this sink. Held by the thread so that its buffer is released for reuse
+    when the thread exits. */
+    struct ThreadBuffers {
+        vector<pair<uint64_t, shared_ptr<ThreadLogBuffer>>> buffers;
+
+        ~ThreadBuffers() {
+            for (auto &entry: buffers)
+                entry.second->owned.store(false);
+        }
+    };
+
+    static uint64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ThreadLogBuffer* getThreadBuffer() {
+        thread_local ThreadBuffers threadBuffers;
+        for (auto &entry: threadBuffers.buffers) {
+            if (entry.first == sinkId)
+                return entry.second.get();
+        }
+
+        shared_ptr<ThreadLogBuffer> buffer = registerThread();
+        threadBuffers.buffers.push_back({sinkId, buffer});
+        return buffer.get();
+    }
+
+    /* Hands out the buffer of an exited thread if there is one, otherwise a new one */
+    shared_ptr<ThreadLogBuffer> registerThread() {
+        lock_guard<mutex> lock(registryMutex);
+        int count = bufferCount.load();
+        for (int i=0; i<count; i++) {
+            bool released = false;
+            if (buffers[i]->owned.compare_exchange_strong(released, true))
+                return buffers[i];
+        }
+
+        if (count == MAX_THREADS)
+            throw runtime_error("too many threads logging to a PerThreadLogSink");
+
+        buffers[count] = make_shared<ThreadLogBuffer>(bufferCapacity);
+        bufferCount.store(count + 1);
+        return buffers[count];
+    }
+
+    /* Writes out every record older than the watermark in timestamp order, returns the number of records written */
+    size_t mergeRound(string &batch) {
+        uint64_t watermark = now();
+        int count = bufferCount.load();
+        for (int i=0; i<count; i++)
+            watermark = min(watermark, buffers[i]->inFlight.load());
+
+        // min heap of (timestamp of the oldest unread record, buffer)
+        priority_queue<pair<uint64_t, int>, vector<pair<uint64_t, int>>, greater<pair<uint64_t, int>>> heads;
+        for (int i=0; i<count; i++) {
+            ThreadLogBuffer *buffer = buffers[i].get();
+            size_t head = buffer->head.load(memory_order_relaxed);
+            if (head != buffer->tail.load(memory_order_acquire))
+                heads.push({buffer->entries[head % buffer->capacity].timestamp, i});
+        }
+
+        size_t written = 0;
+        while (!heads.empty() && heads.top().first < watermark)
+        {
+            int i = heads.top().second;
+            heads.pop();
+
+            // keep draining the same buffer for as long as it holds the oldest record
+            uint64_t limit = heads.empty() ? watermark : min(watermark, heads.top().first + 1);
+            ThreadLogBuffer *buffer = buffers[i].get();
+            size_t head = buffer->head.load(memory_order_relaxed);
+            size_t tail = buffer->tail.load(memory_order_acquire);
+            while (head != tail && buffer->entries[head % buffer->capacity].timestamp < limit)
+            {
+                ThreadLogBuffer::Entry &entry = buffer->entries[head % buffer->capacity];
+                if (printTimestamps) {
+                    char stamp[24];
+                    batch.push_back('[');
+                    batch.append(stamp, to_chars(stamp, stamp + sizeof(stamp), entry.timestamp).ptr - stamp);
+                    batch.append("] ");
+                }
+                batch.append(getLogLevelName(entry.record.level));
+                batch.append(": ");
+                batch.append(entry.record.text, entry.record.length);
+                batch.push_back('\n');
+                head++;
+                written++;
+            }
+            buffer->head.store(head, memory_order_release);
+
+            if (head != tail)
+                heads.push({buffer->entries[head % buffer->capacity].timestamp, i});
+        }
+
+        if (!batch.empty()) {
+            out.write(batch.data(), batch.size());
+            out.flush();
+            LogMetrics::getInstance()->recordBytes(batch.size());
+            batch.clear();
+        }
+
+        completedWatermark.store(heads.empty() ? watermark : min(watermark, heads.top().first));
+        return written;
+    }
+
+    void run() {
+        string batch;
+        while (true)
+        {
+            size_t written = mergeRound(batch);
+            {
+                unique_lock<mutex> lock(stateMutex);
+                roundCompleted.notify_all();
+                if (written == 0) {
+                    if (stopping.load())
+                        break;
+                    wakeMerger.wait_for(lock, chrono::milliseconds(1));
+                }
+            }
+        }
+    }
+
+public:
+    PerThreadLogSink(ostream &out, size_t bufferCapacity = 1024, bool printTimestamps = false): out(out) {
+        this->bufferCapacity = bufferCapacity;
+        this->printTimestamps = printTimestamps;
+        this->sinkId = nextSinkId.fetch_add(1);
+        this->merger = thread(&PerThreadLogSink::run, this);
+    }
+
+    ~PerThreadLogSink() {
+        shutdown();
+    }
+
+    bool write(LogLevel level, string_view msg) {
+        ThreadLogBuffer *buffer = getThreadBuffer();
+        size_t tail = buffer->tail.load(memory_order_relaxed);
+        while (tail - buffer->head.load(memory_order_acquire) == buffer->capacity) {
+            wakeMerger.notify_one();
+            this_thread::yield();
+        }
+
+        // merger must not write anything newer than this record until it has been published
+        buffer->inFlight.store(buffer->lastTimestamp);
+
+        ThreadLogBuffer::Entry &entry = buffer->entries[tail % buffer->capacity];
+        entry.timestamp = max(now(), buffer->lastTimestamp);
+        entry.record.level = level;
+        entry.record.length = min(msg.size(), LogRecord::MAX_TEXT_LENGTH);
+        memcpy(entry.record.text, msg.data(), entry.record.length);
+
+        buffer->lastTimestamp = entry.timestamp;
+        buffer->tail.store(tail + 1, memory_order_release);
+        buffer->inFlight.store(ThreadLogBuffer::IDLE);
+        return true;
+    }
+
+    /* Barrier: returns once every record logged before this call has been written out */
+    void flush() {
+        uint64_t target = now();
+        unique_lock<mutex> lock(stateMutex);
+        while (completedWatermark.load() <= target && merger.joinable()) {
+            wakeMerger.notify_one();
+            roundCompleted.wait_for(lock, chrono::milliseconds(1));
+        }
+    }
+
+    /* Drains all the buffers and stops the merger thread */
+    void shutdown() {
+        if (stopping.load())
+            return;
+
+        flush();
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping.store(true);
+            wakeMerger.notify_one();
+        }
+        merger.join();
+    }
+};
+
+atomic<uint64_t> PerThreadLogSink::nextSinkId{1};
+
+/* =========================================================== */
+/* ================ Memory Mapped File Sink ================== */
+/* =========================================================== */
+
+/* One pre-sized log file mapped into memory, records are appended to it with a plain memcpy */
+struct LogSegment
+{
+    string path;
+    int fd;
+    char *data;
+    size_t size;
+    size_t used = 0;
+    size_t synced = 0;
+};
+
+/* Sink which appends records to memory mapped segment files. A segment is pre-sized on creation, rolled over to
+the next file once it is full or has been open for longer than the roll interval, and a background thread syncs
+the written pages to disk with msync so that no write ever waits for the disk. Segments are named <base>.<n>.log, a sink
+started again on the same base numbers its segments on from the last one on disk and never overwrites one. */
+class MappedFileSink: public LogSink
+{
+    string basePath;
+    size_t segmentSize;
+    chrono::seconds rollInterval;
+    chrono::milliseconds syncInterval;
+
+    mutex closeMutex;                   // held by the syncer while it closes rolled over segments, taken before segmentMutex
+    mutex segmentMutex;
+    LogSegment *current = NULL;
+    vector<LogSegment*> retired;        // rolled over segments waiting for their final sync by the syncer
+    int nextSegmentIndex = 0;
+    vector<string> segmentPaths;        // of the segments created by this sink
+    chrono::steady_clock::time_point openedAt;
+    atomic<bool> rollRequested{false};
+
+    atomic<bool> stopping{false};
+    mutex syncMutex;
+    condition_variable wakeSyncer;
+    thread syncer;
+
+    /* Index after the highest segment of the base already on disk, 0 if there is none */
+    int findNextSegmentIndex() {
+        filesystem::path base(basePath);
+        filesystem::path directory = base.has_parent_path() ? base.parent_path() : filesystem::path(".");
+        string prefix = base.filename().string() + ".";
+        int next = 0;
+        error_code error;
+        for (auto &entry: filesystem::directory_iterator(directory, error)) {
+            string name = entry.path().filename().string();
+            if (name.size() <= prefix.size() + 4 || name.compare(0, prefix.size(), prefix) != 0 || name.compare(name.size() - 4, 4, ".log") != 0)
+                continue;
+            string index = name.substr(prefix.size(), name.size() - prefix.size() - 4);
+            if (all_of(index.begin(), index.end(), ::isdigit) && index.size() <= 9)
+                next = max(next, stoi(index) + 1);
+        }
+        return next;
+    }
+
+    LogSegment* openSegment() {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%06d.log", nextSegmentIndex++);
+
+        LogSegment *segment = new LogSegment();
+        segment->path = basePath + suffix;
+        segment->size = segmentSize;
+        segment->fd = open(segment->path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (segment->fd < 0 || ftruncate(segment->fd, segmentSize) != 0)
+            throw runtime_error("unable to create log segment " + segment->path);
+        segmentPaths.push_back(segment->path);
+
+        void *data = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        if (data == MAP_FAILED)
+            throw runtime_error("unable to map log segment " + segment->path);
+        madvise(data, segmentSize, MADV_SEQUENTIAL);
+
+        segment->data = (char*)data;
+        openedAt = chrono::steady_clock::now();
+        return segment;
+    }
+
+    /* Final sync of a full segment, the unused tail of the pre-sized file is cut off */
+    static void closeSegment(LogSegment *segment) {
+        msync(segment->data, segment->size, MS_SYNC);
+        munmap(segment->data, segment->size);
+        if (ftruncate(segment->fd, segment->used) != 0)
+            cerr << "unable to truncate log segment " << segment->path << endl;
+        close(segment->fd);
+        delete segment;
+    }
+
+    void roll() {
+        retired.push_back(current);
+        current = openSegment();
+        rollRequested.store(false);
+        wakeSyncer.notify_one();
+    }
+
+    /* Syncs the pages written since the last sync, called without holding the segment lock */
+    static void syncSegment(LogSegment *segment, size_t used) {
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        if (used <= segment->synced)
+            return;
+
+        size_t from = segment->synced / pageSize * pageSize;
+        msync(segment->data + from, used - from, MS_SYNC);
+        segment->synced = used;
+    }
+
+    void runSyncer() {
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(syncMutex);
+                wakeSyncer.wait_for(lock, syncInterval);
+            }
+
+            LogSegment *segment;
+            size_t used;
+            vector<LogSegment*> rolledOver;
+            lock_guard<mutex> closeLock(closeMutex);
+            {
+                lock_guard<mutex> lock(segmentMutex);
+                segment = current;
+                used = current->used;
+                rolledOver.swap(retired);
+                if (chrono::steady_clock::now() - openedAt >= rollInterval && current->used > 0)
+                    rollRequested.store(true);
+            }
+
+            // the current segment can only be retired after this point, and retired ones are only closed by us
+            syncSegment(segment, used);
+            for (LogSegment *rolled: rolledOver)
+                closeSegment(rolled);
+
+            if (stopping.load())
+                break;
+        }
+    }
+
+public:
+    MappedFileSink(const string &basePath, size_t segmentSize = 64 << 20, chrono::seconds rollInterval = chrono::hours(1),
+            chrono::milliseconds syncInterval = chrono::milliseconds(100)) {
+        this->basePath = basePath;
+        this->segmentSize = segmentSize;
+        this->rollInterval = rollInterval;
+        this->syncInterval = syncInterval;
+        this->nextSegmentIndex = findNextSegmentIndex();
+        this->current = openSegment();
+        this->syncer = thread(&MappedFileSink::runSyncer, this);
+    }
+
+    ~MappedFileSink() {
+        shutdown();
+    }
+
+    bool write(LogLevel level, string_view msg) {
+        const char *name = getLogLevelName(level);
+        size_t nameLength = strlen(name);
+        size_t length = min(nameLength + 2 + msg.size() + 1, segmentSize);
+        size_t msgLength = length - nameLength - 3;
+
+        lock_guard<mutex> lock(segmentMutex);
+        if (current->used + length > segmentSize || rollRequested.load())
+            roll();
+
+        char *out = current->data + current->used;
+        memcpy(out, name, nameLength);
+        memcpy(out + nameLength, ": ", 2);
+        memcpy(out + nameLength + 2, msg.data(), msgLength);
+        out[length - 1] = '\n';
+        current->used += length;
+        LogMetrics::getInstance()->recordBytes(length);
+        return true;
+    }
+
+    /* Synchronously syncs everything written so far to disk, pages which are already clean cost next to nothing.
+    Waits for the segments the syncer is closing, and syncs the rolled over ones it has not taken yet. */
+    void flush() {
+        lock_guard<mutex> closeLock(closeMutex);
+        lock_guard<mutex> lock(segmentMutex);
+        for (LogSegment *rolled: retired)
+            msync(rolled->data, rolled->used, MS_SYNC);
+        if (current != NULL && current->used > 0)
+            msync(current->data, current->used, MS_SYNC);
+    }
+
+    /* Stops the syncer and closes all the segments, records written after shutdown are lost */
+    void shutdown() {
+        if (stopping.exchange(true))
+            return;
+
+        {
+            lock_guard<mutex> lock(syncMutex);
+            wakeSyncer.notify_one();
+        }
+        syncer.join();
+
+        lock_guard<mutex> lock(segmentMutex);
+        for (LogSegment *rolled: retired)
+            closeSegment(rolled);
+        retired.clear();
+        closeSegment(current);
+        current = NULL;
+    }
+
+    int getSegmentCount() {
+        return segmentPaths.size();
+    }
+
+    /* Paths of the segments created by this sink, oldest first */
+    vector<string> getSegmentPaths() {
+        lock_guard<mutex> lock(segmentMutex);
+        return segmentPaths;
+    }
+};
+
+/* Logger which handles the given set of levels, used to put a file (or any other sink) into the chain as another handler */
+class FileLogger: public Logger {
+    bool levels[LOG_LEVEL_COUNT] = {false};
+
+public:
+    FileLogger(Logger *nextLogger, LogSink *sink, initializer_list<LogLevel> levels): Logger(nextLogger, sink) {
+        for (LogLevel level: levels)
+            this->levels[level] = true;
+    }
+
+    bool canHandle(LogLevel level) {
+        return isLogLevelEnabled(level) && levels[level];
+    }
+
+    void log(LogLevel level, string_view msg) {
+        if (canHandle(level)) {
+            write(level, msg);
+        } else {
+            Logger::log(level, msg);
+        }
+    }
+};
+
+/* =========================================================== */
+/* ===================== Binary Log Format =================== */
+/* =========================================================== */
+
+/* Every record in a binary log starts with this header and is followed by payloadSize bytes of arguments.
+A record with level FORMAT_DEFINITION carries the text of format string formatId instead, it is written the first
+time an id shows up in the file so that the decoder does not need access to the running process. */
+struct BinaryRecordHeader
+{
+    static const uint8_t FORMAT_DEFINITION = 0xFF;
+
+    uint64_t timestamp;     // nanoseconds since epoch
+    uint32_t formatId;
+    uint16_t payloadSize;
+    uint8_t level;
+    uint8_t argCount;
+};
+
+const char BINARY_LOG_MAGIC[8] = {'B', 'L', 'O', 'G', '0', '0', '0', '1'};
+
+/* Sink which stores records in binary instead of text: a small header followed by the raw arguments, numbers and
+pointers are copied as 8 bytes and strings as length + bytes. Text is produced later, offline, by decodeBinaryLog. */
+class BinaryLogSink: public LogSink
+{
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    string path;
+    FILE *file;
+    mutex bufferMutex;
+    unique_ptr<char[]> buffer;
+    size_t used = 0;
+    vector<bool> definedFormats;    // format ids whose definition has already been written to this file
+    uint32_t textFormatId;          // "{}", used for records which reach us as plain text
+
+    void append(const void *data, size_t size) {
+        memcpy(buffer.get() + used, data, size);
+        used += size;
+    }
+
+    void appendHeader(uint64_t timestamp, uint32_t formatId, uint8_t level, size_t payloadSize, size_t argCount) {
+        BinaryRecordHeader header;
+        header.timestamp = timestamp;
+        header.formatId = formatId;
+        header.payloadSize = payloadSize;
+        header.level = level;
+        header.argCount = argCount;
+        append(&header, sizeof(header));
+    }
+
+    void defineFormat(uint32_t formatId, string_view fmt) {
+        if (formatId < definedFormats.size() && definedFormats[formatId])
+            return;
+
+        if (formatId >= definedFormats.size())
+            definedFormats.resize(formatId + 1, false);
+        definedFormats[formatId] = true;
+
+        fmt = fmt.substr(0, UINT16_MAX);
+        appendHeader(0, formatId, BinaryRecordHeader::FORMAT_DEFINITION, fmt.size(), 0);
+        append(fmt.data(), fmt.size());
+    }
+
+    static size_t getEncodedSize(const FormatArg &arg) {
+        if (arg.type == FormatArg::STRING)
+            return 1 + sizeof(uint16_t) + min(arg.s.size(), (size_t)UINT16_MAX);
+        return 1 + sizeof(uint64_t);
+    }
+
+    void appendArg(const FormatArg &arg) {
+        uint8_t type = arg.type;
+        append(&type, 1);
+        if (arg.type == FormatArg::STRING) {
+            uint16_t length = min(arg.s.size(), (size_t)UINT16_MAX);
+            append(&length, sizeof(length));
+            append(arg.s.data(), length);
+        } else {
+            append(&arg.u, sizeof(uint64_t));
+        }
+    }
+
+    void flushBuffer() {
+        size_t written = fwrite(buffer.get(), 1, used, file);
+        LogMetrics::getInstance()->recordBytes(written);
+        if (written != used)
+            cerr << "unable to write binary log " << path << endl;
+        used = 0;
+    }
+
+public:
+    BinaryLogSink(const string &path) {
+        this->path = path;
+        this->file = fopen(path.c_str(), "wb");
+        if (file == NULL)
+            throw runtime_error("unable to open binary log " + path);
+
+        if (fwrite(BINARY_LOG_MAGIC, 1, sizeof(BINARY_LOG_MAGIC), file) != sizeof(BINARY_LOG_MAGIC)) {
+            fclose(file);
+            throw runtime_error("unable to write binary log " + path);
+        }
+        this->buffer.reset(new char[BUFFER_SIZE]);
+        this->textFormatId = LogFormatRegistry::getInstance()->registerFormat("{}");
+    }
+
+    ~BinaryLogSink() {
+        flush();
+        if (fclose(file) != 0)
+            cerr << "unable to write binary log " << path << endl;
+    }
+
+    bool write(LogLevel level, string_view msg) {
+        FormatArg arg = makeFormatArg(msg);
+        return writeArgs(level, textFormatId, "{}", &arg, 1);
+    }
+
+    /* Records with an unregistered format are written as plain text, registering their format here would take the
+    registry lock & grow it on every record */
+    bool writeArgs(LogLevel level, uint32_t formatId, string_view fmt, const FormatArg *args, size_t count) {
+        if (formatId == LogFormatRegistry::UNREGISTERED)
+            return LogSink::writeArgs(level, formatId, fmt, args, count);
+
+        uint64_t timestamp = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        size_t payloadSize = 0;
+        for (size_t i=0; i<count; i++)
+            payloadSize += getEncodedSize(args[i]);
+
+        // records which don't fit in the header are cut down to the arguments which do
+        while (payloadSize > UINT16_MAX && count > 0)
+            payloadSize -= getEncodedSize(args[--count]);
+
+        // worst case the record is preceded by the definition of its format string
+        size_t maxRecordSize = 2 * sizeof(BinaryRecordHeader) + UINT16_MAX + payloadSize;
+
+        lock_guard<mutex> lock(bufferMutex);
+        if (used + maxRecordSize > BUFFER_SIZE)
+            flushBuffer();
+
+        defineFormat(formatId, fmt);
+        appendHeader(timestamp, formatId, level, payloadSize, count);
+        for (size_t i=0; i<count; i++)
+            appendArg(args[i]);
+        return true;
+    }
+
+    void flush() {
+        lock_guard<mutex> lock(bufferMutex);
+        flushBuffer();
+        if (fflush(file) != 0)
+            cerr << "unable to write binary log " << path << endl;
+    }
+};
+
+/* Offline decoder, turns a binary log written by BinaryLogSink back into text. Returns the number of records decoded
+or -1 if the file is not a binary log. */
+long long decodeBinaryLog(const string &path, ostream &out)
+{
+    ifstream in(path, ios::binary);
+    char magic[sizeof(BINARY_LOG_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, BINARY_LOG_MAGIC, sizeof(magic)) != 0)
+        return -1;
+
+    unordered_map<uint32_t, string> formats;   // by format id, ids come from the file so they are not used as indexes
+    vector<char> payload;
+    vector<FormatArg> args;
+    string line;
+    long long records = 0;
+
+    BinaryRecordHeader header;
+    while (in.read((char*)&header, sizeof(header)))
+    {
+        payload.resize(header.payloadSize);
+        if (!in.read(payload.data(), payload.size()))
+            break;
+
+        if (header.level == BinaryRecordHeader::FORMAT_DEFINITION) {
+            formats[header.formatId].assign(payload.data(), payload.size());
+            continue;
+        }
+
+        // the payload comes from the file, a record whose arguments run past it or have an unknown type is skipped
+        args.clear();
+        size_t offset = 0;
+        bool isCorrupt = false;
+        for (int i=0; i<header.argCount && offset < payload.size(); i++) {
+            FormatArg arg;
+            uint8_t type = payload[offset++];
+            arg.type = (FormatArg::Type)type;
+            if (type > FormatArg::POINTER) {
+                isCorrupt = true;
+                break;
+            } else if (arg.type == FormatArg::STRING) {
+                uint16_t length;
+                if (offset + sizeof(length) > payload.size()) {
+                    isCorrupt = true;
+                    break;
+                }
+                memcpy(&length, &payload[offset], sizeof(length));
+                offset += sizeof(length);
+                if (offset + length > payload.size()) {
+                    isCorrupt = true;
+                    break;
+                }
+                arg.s = string_view(payload.data() + offset, length);
+                offset += length;
+            } else {
+                if (offset + sizeof(uint64_t) > payload.size()) {
+                    isCorrupt = true;
+                    break;
+                }
+                memcpy(&arg.u, &payload[offset], sizeof(uint64_t));
+                offset += sizeof(uint64_t);
+            }
+            args.push_back(arg);
+        }
+        if (isCorrupt)
+            continue;
+
+        time_t seconds = header.timestamp / 1000000000ULL;
+        tm utc;
+        gmtime_r(&seconds, &utc);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &utc);
+
+        line.clear();
+        auto format = formats.find(header.formatId);
+        string_view fmt = format != formats.end() ? string_view(format->second) : string_view("<unknown format>");
+        formatArgsTo(line, fmt, args.data(), args.size());
+        out << stamp << "." << setw(6) << setfill('0') << (header.timestamp / 1000) % 1000000 << setfill(' ')
+            << " " << getLogLevelName((LogLevel)header.level) << ": " << line << "\n";
+        records++;
+    }
+
+    return records;
+}
+
+/* =========================================================== */
+/* ======================== Benchmarks ======================= */
+/* =========================================================== */
+
+/* Sink which only counts records, used to measure the cost of the logging path without any I/O */
+class NullSink: public LogSink
+{
+public:
+    uint64_t records = 0;
+
+    bool write(LogLevel, string_view) {
+        records++;
+        return true;
+    }
+};
+
+/* Builds a chain of given number of handlers where the ERROR handler is always the last one in the chain */
+Logger* buildChain(int handlers, LogSink *sink)
+{
+    Logger *chain = new ErrorLogger(NULL, sink);
+    for (int i=1; i<handlers; i++) {
+        if (i % 2 == 0)
+            chain = new InfoLogger(chain, sink);
+        else
+            chain = new DebugLogger(chain, sink);
+    }
+    return chain;
+}
+
+/* Compares the chain walk against the compiled dispatch table for chains of 1, 3 and 16 handlers */
+void benchmarkDispatch()
+{
+    const int iterations = 10000000;
+    const string msg = "request served in 12ms for user 42 with status code 200 OK";
+
+    cout << "handlers\tchain ns/call\tdispatcher ns/call" << endl;
+    for (int handlers: {1, 3, 16}) {
+        NullSink sink;
+        Logger *chain = buildChain(handlers, &sink);
+        LogDispatcher dispatcher(chain);
+
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++)
+            chain->log(LogLevel::ERROR, msg);
+        auto mid = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++)
+            dispatcher.log(LogLevel::ERROR, msg);
+        auto end = chrono::steady_clock::now();
+
+        double chainNs = chrono::duration<double, nano>(mid - start).count() / iterations;
+        double dispatcherNs = chrono::duration<double, nano>(end - mid).count() / iterations;
+        cout << handlers << "\t\t" << chainNs << "\t\t" << dispatcherNs << endl;
+
+        if (sink.records != 2ULL * iterations)
+            cout << "unexpected record count " << sink.records << endl;
+    }
+}
+
+/* Cost of a DEBUG call when nobody handles DEBUG: eagerly built message versus lazily formatted one.
+Building with -DLOG_MIN_LEVEL=INFO removes the lazy call altogether. */
+void benchmarkDisabledLevel()
+{
+    const int iterations = 10000000;
+    NullSink sink;
+    LogDispatcher dispatcher(new InfoLogger(new ErrorLogger(NULL, &sink), &sink));
+
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<iterations; i++)
+        dispatcher.log(LogLevel::DEBUG, "processed item " + to_string(i) + " of batch " + to_string(iterations));
+    auto mid = chrono::steady_clock::now();
+    for (int i=0; i<iterations; i++)
+        LOG_DEBUG(dispatcher, "processed item {} of batch {}", i, iterations);
+    auto end = chrono::steady_clock::now();
+
+    cout << "disabled DEBUG, eager string ns/call: " << chrono::duration<double, nano>(mid - start).count() / iterations << endl;
+    cout << "disabled DEBUG, lazy format ns/call: " << chrono::duration<double, nano>(end - mid).count() / iterations << endl;
+}
+
+/* Cost of a formatted record written as text versus the same record written in the binary format */
+void benchmarkBinaryFormat()
+{
+    const int iterations = 2000000;
+    const string textPath = "/tmp/logger_bench.log";
+    const string binaryPath = "/tmp/logger_bench.blog";
+
+    double textNs, binaryNs;
+    {
+        ofstream textFile(textPath);
+        StreamSink textSink(textFile);
+        LogDispatcher dispatcher(new InfoLogger(NULL, &textSink));
+
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++)
+            LOG_INFO(dispatcher, "user {} fetched {} bytes in {}ms from {}", i, 4096 + i, 1.25, "cache");
+        textFile.flush();
+        textNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+    }
+    {
+        BinaryLogSink binarySink(binaryPath);
+        LogDispatcher dispatcher(new InfoLogger(NULL, &binarySink));
+
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++)
+            LOG_INFO(dispatcher, "user {} fetched {} bytes in {}ms from {}", i, 4096 + i, 1.25, "cache");
+        binarySink.flush();
+        binaryNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+    }
+
+    cout << "text format ns/record: " << textNs << endl;
+    cout << "binary format ns/record: " << binaryNs << endl;
+    remove(textPath.c_str());
+    remove(binaryPath.c_str());
+}
+
+/* N producer threads log into a PerThreadLogSink, checks that no line is torn or lost, that every producer's records
+come out in order and that the merged output is in timestamp order */
+bool stressTestPerThreadSink(int threads, int recordsPerThread, double &recordsPerSecond)
+{
+    ostringstream out;
+    auto start = chrono::steady_clock::now();
+    {
+        PerThreadLogSink sink(out, 1024, true);
+        LogDispatcher dispatcher(new InfoLogger(NULL, &sink));
+
+        vector<thread> producers;
+        for (int t=0; t<threads; t++) {
+            producers.push_back(thread([&dispatcher, t, recordsPerThread]() {
+                for (int i=0; i<recordsPerThread; i++)
+                    LOG_INFO(dispatcher, "producer {} record {} payload abcdefghijklmnopqrstuvwxyz", t, i);
+            }));
+        }
+        for (auto &producer: producers)
+            producer.join();
+    }
+    recordsPerSecond = (double)threads * recordsPerThread / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    istringstream in(out.str());
+    vector<int> nextRecord(threads, 0);
+    uint64_t lastTimestamp = 0;
+    string line;
+    long long lines = 0;
+    while (getline(in, line)) {
+        unsigned long long timestamp;
+        int producer, record, consumed = 0;
+        if (sscanf(line.c_str(), "[%llu] INFO: producer %d record %d payload abcdefghijklmnopqrstuvwxyz%n", &timestamp, &producer, &record, &consumed) != 3
+            || consumed != (int)line.size() || producer < 0 || producer >= threads) {
+            cout << "torn line: " << line << endl;
+            return false;
+        }
+        if (record != nextRecord[producer]++ || timestamp < lastTimestamp) {
+            cout << "out of order line: " << line << endl;
+            return false;
+        }
+        lastTimestamp = timestamp;
+        lines++;
+    }
+
+    if (lines != (long long)threads * recordsPerThread) {
+        cout << "lost records, expected " << (long long)threads * recordsPerThread << " got " << lines << endl;
+        return false;
+    }
+    return true;
+}
+
+/* Records per second of a single mutex protected stream shared by all threads, the baseline for per thread buffers */
+double measureLockedStream(int threads, int recordsPerThread)
+{
+    class LockedStreamSink: public StreamSink {
+        mutex streamMutex;
+    public:
+        LockedStreamSink(ostream &out): StreamSink(out) {}
+        bool write(LogLevel level, string_view msg) {
+            lock_guard<mutex> lock(streamMutex);
+            return StreamSink::write(level, msg);
+        }
+    };
+
+    ostringstream out;
+    LockedStreamSink sink(out);
+    LogDispatcher dispatcher(new InfoLogger(NULL, &sink));
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> producers;
+    for (int t=0; t<threads; t++) {
+        producers.push_back(thread([&dispatcher, t, recordsPerThread]() {
+            for (int i=0; i<recordsPerThread; i++)
+                LOG_INFO(dispatcher, "producer {} record {} payload abcdefghijklmnopqrstuvwxyz", t, i);
+        }));
+    }
+    for (auto &producer: producers)
+        producer.join();
+
+    return (double)threads * recordsPerThread / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkPerThreadBuffers()
+{
+    const int recordsPerThread = 100000;
+
+    cout << "threads\tper thread buffers rec/s\tlocked stream rec/s" << endl;
+    for (int threads: {1, 2, 4, 8, 16, 32}) {
+        double perThread;
+        if (!stressTestPerThreadSink(threads, recordsPerThread, perThread)) {
+            cout << "stress test failed with " << threads << " threads" << endl;
+            return;
+        }
+        cout << threads << "\t" << (long long)perThread << "\t\t\t" << (long long)measureLockedStream(threads, recordsPerThread) << endl;
+    }
+}
+
+/* Writes a million lines through the memory mapped sink and through an ofstream, lines per second of each */
+void benchmarkMappedFile()
+{
+    const int lines = 1000000;
+    const string mappedPath = "/tmp/logger_bench_mapped";
+    const string streamPath = "/tmp/logger_bench_stream.log";
+
+    double mappedRate, streamRate;
+    vector<string> segmentPaths;
+    {
+        MappedFileSink sink(mappedPath, 32 << 20);
+        LogDispatcher dispatcher(new FileLogger(NULL, &sink, {LogLevel::INFO}));
+
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<lines; i++)
+            LOG_INFO(dispatcher, "request {} served in {}ms with status {}", i, i % 100, 200);
+        sink.shutdown();
+        mappedRate = lines / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        segmentPaths = sink.getSegmentPaths();
+    }
+    {
+        ofstream file(streamPath);
+        StreamSink sink(file);
+        LogDispatcher dispatcher(new FileLogger(NULL, &sink, {LogLevel::INFO}));
+
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<lines; i++)
+            LOG_INFO(dispatcher, "request {} served in {}ms with status {}", i, i % 100, 200);
+        file.close();
+        streamRate = lines / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    cout << "mapped file lines/s: " << (long long)mappedRate << " (" << segmentPaths.size() << " segments)" << endl;
+    cout << "ofstream lines/s: " << (long long)streamRate << endl;
+
+    for (string &path: segmentPaths)
+        remove(path.c_str());
+    remove(streamPath.c_str());
+}
+
+/* Cost of a record dropped by the rate limiter, by the dedup window and by the token bucket */
+void benchmarkRateLimiting()
+{
+    const int iterations = 10000000;
+    NullSink sink;
+
+    RateLimitConfig dedupConfig;
+    dedupConfig.dedupWindow = chrono::seconds(60);
+    RateLimitingLogger dedupLimiter(new ErrorLogger(NULL, &sink), dedupConfig);
+    LogDispatcher dedupDispatcher(&dedupLimiter);
+
+    RateLimitConfig bucketConfig;
+    bucketConfig.levelRate[LogLevel::ERROR] = 1000;
+    bucketConfig.siteRate = 100;
+    RateLimitingLogger bucketLimiter(new ErrorLogger(NULL, &sink), bucketConfig);
+    LogDispatcher bucketDispatcher(&bucketLimiter);
+
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<iterations; i++)
+        LOG_ERROR(dedupDispatcher, "connection to {} refused", "db-primary");
+    auto mid = chrono::steady_clock::now();
+    for (int i=0; i<iterations; i++)
+        LOG_ERROR(bucketDispatcher, "connection to {} refused, attempt {}", "db-primary", i);
+    auto end = chrono::steady_clock::now();
+
+    cout << "deduplicated record ns/call: " << chrono::duration<double, nano>(mid - start).count() / iterations
+         << " (" << dedupLimiter.getDroppedCount() << " dropped)" << endl;
+    cout << "rate limited record ns/call: " << chrono::duration<double, nano>(end - mid).count() / iterations
+         << " (" << bucketLimiter.getDroppedCount() << " dropped)" << endl;
+}
+
+struct LatencyStats
+{
+    double p50;
+    double p99;
+    double p999;
+    double callsPerSecond;
+    double allocationsPerCall;
+};
+
+/* Times every call individually for the percentiles (so they include the cost of reading the clock once), then
+runs the calls again untimed for the calls per second */
+template <typename Call>
+LatencyStats measureLatency(int iterations, Call call)
+{
+    vector<uint32_t> samples(iterations);
+    for (int i=0; i<1000; i++)
+        call(i);
+
+    uint64_t allocationsBefore = getThreadAllocations();
+    for (int i=0; i<iterations; i++) {
+        auto start = chrono::steady_clock::now();
+        call(i);
+        samples[i] = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+    uint64_t allocations = getThreadAllocations() - allocationsBefore;
+
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<iterations; i++)
+        call(i);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(samples.begin(), samples.end());
+    LatencyStats stats;
+    stats.p50 = samples[iterations / 2];
+    stats.p99 = samples[(size_t)(iterations * 0.99)];
+    stats.p999 = samples[(size_t)(iterations * 0.999)];
+    stats.callsPerSecond = iterations / seconds;
+    stats.allocationsPerCall = (double)allocations / iterations;
+    return stats;
+}
+
+/* Latency percentiles, calls per second and allocations per call of every level, for chains of 1, 3 and 16 loggers
+in front of each kind of sink */
+void benchmarkSuite()
+{
+    const int iterations = 100000;
+    const string msg = "request served in 12ms for user 42 with status code 200 OK";
+    ofstream devNull("/dev/null");
+
+    vector<pair<string, function<LogSink*()>>> sinks = {
+        {"null", []() -> LogSink* { return new NullSink(); }},
+        {"stream", [&devNull]() -> LogSink* { return new StreamSink(devNull); }},
+        {"async", [&devNull]() -> LogSink* { return new AsyncLogSink(devNull, 4096, OverflowPolicy::BLOCK); }},
+        {"per-thread", [&devNull]() -> LogSink* { return new PerThreadLogSink(devNull, 4096); }},
+        {"mapped", []() -> LogSink* { return new MappedFileSink("/tmp/logger_suite", 64 << 20); }},
+        {"binary", []() -> LogSink* { return new BinaryLogSink("/tmp/logger_suite.blog"); }},
+    };
+
+    cout << "sink\t\tdepth\tlevel\tp50 ns\tp99 ns\tp999 ns\tcalls/s\t\tallocs/call" << endl;
+    for (auto &entry: sinks) {
+        for (int depth: {1, 3, 16}) {
+            LogSink *sink = entry.second();
+            Logger *chain = buildChain(depth, sink);
+            for (LogLevel level: {LogLevel::INFO, LogLevel::ERROR, LogLevel::DEBUG}) {
+                LatencyStats stats = measureLatency(iterations, [&](int) {
+                    chain->log(level, msg);
+                });
+                cout << left << setw(12) << entry.first << right << "\t" << depth << "\t" << getLogLevelName(level)
+                     << "\t" << stats.p50 << "\t" << stats.p99 << "\t" << stats.p999
+                     << "\t" << (long long)stats.callsPerSecond << "\t" << stats.allocationsPerCall << endl;
+            }
+            sink->flush();
+            delete sink;
+        }
+    }
+
+    for (int i=0; i<100; i++) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%06d.log", i);
+        remove(("/tmp/logger_suite" + string(suffix)).c_str());
+    }
+    remove("/tmp/logger_suite.blog");
+}
+
+void runBenchmarks()
+{
+    if (!ALLOCATIONS_COUNTED)
+        cout << "allocations are only counted in bench builds (-DBENCH_BUILD)" << endl;
+    benchmarkDispatch();
+    benchmarkDisabledLevel();
+    benchmarkBinaryFormat();
+    benchmarkPerThreadBuffers();
+    benchmarkMappedFile();
+    benchmarkRateLimiting();
+    benchmarkSuite();
+    LogMetrics::getInstance()->print(cout);
+}
+
+/* Driver function, pass --bench to run the benchmarks or --decode <file> to print a binary log as text */
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runBenchmarks();
+        return 0;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--decode") {
+        if (decodeBinaryLog(argv[2], cout) < 0) {
+            cerr << argv[2] << " is not a binary log" << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    Logger *logger = new InfoLogger(new DebugLogger(new ErrorLogger(NULL)));
+
+    logger->log(LogLevel::ERROR, "something went wrong!");
+    logger->log(LogLevel::INFO, "new day, new challenges");
+    logger->log(LogLevel::DEBUG, "debugging is fun if you understand the code.");
+
+    // compiled chain, each level is dispatched straight to the logger owning it
+    LogDispatcher dispatcher(logger);
+    dispatcher.log(LogLevel::DEBUG, "dispatched without walking the chain.");
+
+    // message is formatted only if some logger is going to write it
+    LOG_INFO(dispatcher, "{} loggers in the chain, {} levels", 3, LOG_LEVEL_COUNT);
+    LOG_ERROR(*logger, "request {} failed after {}ms", "GET /index.html", 12.5);
+
+    // an error storm is collapsed to the first record and a summary of the suppressed ones
+    RateLimitConfig rateLimitConfig;
+    rateLimitConfig.dedupWindow = chrono::seconds(1);
+    RateLimitingLogger *rateLimiter = new RateLimitingLogger(new InfoLogger(new DebugLogger(new ErrorLogger(NULL))), rateLimitConfig);
+    for (int i=0; i<1000; i++)
+        LOG_ERROR(*rateLimiter, "database {} is unreachable", "orders");
+    rateLimiter->flushSuppressed();
+    delete rateLimiter;
+
+    // same chain, but records are written out by a background thread
+    AsyncLogSink asyncSink(cout, 1024, OverflowPolicy::BLOCK);
+    Logger *asyncLogger = new InfoLogger(new DebugLogger(new ErrorLogger(NULL, &asyncSink), &asyncSink), &asyncSink);
+
+    asyncLogger->log(LogLevel::ERROR, "something went wrong asynchronously!");
+    asyncLogger->log(LogLevel::INFO, "logging no longer waits for the console");
+    asyncLogger->log(LogLevel::DEBUG, "records are flushed before the process exits.");
+
+    // no records are lost, flush blocks till the writer thread has written everything logged so far
+    asyncSink.flush();
+
+    // every thread logs into a buffer of its own, the records are merged back in timestamp order
+    {
+        PerThreadLogSink perThreadSink(cout);
+        LogDispatcher perThreadDispatcher(new InfoLogger(NULL, &perThreadSink));
+        thread worker([&perThreadDispatcher]() {
+            LOG_INFO(perThreadDispatcher, "worker {} started", 1);
+        });
+        worker.join();
+        LOG_INFO(perThreadDispatcher, "main thread logged after the worker");
+    }
+
+    // errors also go to a memory mapped file, the file logger is just another handler in the chain
+    vector<string> segmentPaths;
+    {
+        MappedFileSink fileSink("logger_demo", 1 << 20);
+        Logger *fileChain = new InfoLogger(new FileLogger(new DebugLogger(NULL), &fileSink, {LogLevel::ERROR}));
+        fileChain->log(LogLevel::ERROR, "disk is almost full");
+        fileChain->log(LogLevel::INFO, "cleanup scheduled");
+        segmentPaths = fileSink.getSegmentPaths();
+    }
+    for (string &path: segmentPaths) {
+        cout << ifstream(path).rdbuf();
+        remove(path.c_str());
+    }
+
+    // binary mode, only the format id and raw arguments are stored and the file is decoded offline
+    {
+        BinaryLogSink binarySink("logger_demo.blog");
+        LogDispatcher binaryDispatcher(new InfoLogger(new ErrorLogger(NULL, &binarySink), &binarySink));
+        LOG_INFO(binaryDispatcher, "order {} placed for {} items", 1001, 3);
+        LOG_ERROR(binaryDispatcher, "payment for order {} declined: {}", 1001, "insufficient funds");
+        binaryDispatcher.log(LogLevel::INFO, "plain text records work as well");
+    }
+    decodeBinaryLog("logger_demo.blog", cout);
+    remove("logger_demo.blog");
+
+    // counters of the whole logging system can be read at any time
+    LogMetrics::getInstance()->print(cout);
 
     return 0;
 }
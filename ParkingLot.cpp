@@ -1,6 +1,190 @@
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "IdGenerator.h"
 using namespace std;
 
+/* =========================================================== */
+/* ======================= Object Pools ====================== */
+/* =========================================================== */
+
+/* Lock free stack of indices (Treiber stack). The link of every index lives in an array owned by the user of the stack,
+next(index) returns it. The head carries a tag bumped on every change so that a pop can't succeed on a head which was
+popped & pushed back in the meantime (ABA). */
+class alignas(64) IndexStack
+{
+    atomic<uint64_t> head{NIL};   // index of the top in the low 32 bits, the tag in the high 32 bits
+
+public:
+    static constexpr uint32_t NIL = 0xFFFFFFFF;
+
+    template <typename Links>
+    void push(uint32_t index, Links &&next) {
+        uint64_t top = head.load(memory_order_relaxed);
+        do {
+            next(index).store((uint32_t)top, memory_order_relaxed);
+        } while (!head.compare_exchange_weak(top, ((top >> 32) + 1) << 32 | index, memory_order_release, memory_order_relaxed));
+    }
+
+    /* Pushes a chain of indices already linked from first to last at once */
+    template <typename Links>
+    void pushChain(uint32_t first, uint32_t last, Links &&next) {
+        uint64_t top = head.load(memory_order_relaxed);
+        do {
+            next(last).store((uint32_t)top, memory_order_relaxed);
+        } while (!head.compare_exchange_weak(top, ((top >> 32) + 1) << 32 | first, memory_order_release, memory_order_relaxed));
+    }
+
+    template <typename Links>
+    uint32_t pop(Links &&next) {
+        uint64_t top = head.load(memory_order_acquire);
+        while ((uint32_t)top != NIL) {
+            uint64_t newTop = ((top >> 32) + 1) << 32 | next((uint32_t)top).load(memory_order_relaxed);
+            if (head.compare_exchange_weak(top, newTop, memory_order_acquire, memory_order_acquire))
+                return (uint32_t)top;
+        }
+        return NIL;
+    }
+
+    bool isEmpty() {
+        return (uint32_t)head.load(memory_order_relaxed) == NIL;
+    }
+};
+
+/* Typed pool of objects in 64KB slabs, so objects never move and released ones are reused instead of going back to the
+heap. Every object has a compact id (slab number * objects per slab + position in the slab). Slabs are aligned to their
+size, so the id of an object is found from its address through the slab number in the slab's header. Creating and
+releasing objects is lock free, only adding a slab takes a lock. Slabs are never returned, memory stays at the peak
+number of live objects. */
+template <typename T>
+class ObjectPool
+{
+    static const size_t SLAB_BYTES = 1 << 16;
+    static const size_t HEADER_BYTES = 64;
+    static const uint32_t MAX_SLABS = 1 << 16;
+
+    static_assert(alignof(T) <= HEADER_BYTES, "objects must not need more alignment than the slab header");
+
+public:
+    static const uint32_t OBJECTS_PER_SLAB = (SLAB_BYTES - 2 * HEADER_BYTES) / (sizeof(T) + sizeof(uint32_t));
+
+private:
+    // slab layout: header (the slab number), the free list link of every object, the objects
+    static const size_t OBJECTS_OFFSET = (HEADER_BYTES + OBJECTS_PER_SLAB * sizeof(uint32_t) + HEADER_BYTES - 1) / HEADER_BYTES * HEADER_BYTES;
+
+    unique_ptr<atomic<char*>[]> slabs;
+    atomic<uint32_t> slabCount{0};
+    atomic<long long> liveCount{0};
+    IndexStack freeList;
+    mutex growMutex;
+
+    char* getSlab(uint32_t id) {
+        return slabs[id / OBJECTS_PER_SLAB].load(memory_order_acquire);
+    }
+
+    atomic<uint32_t>& getLink(uint32_t id) {
+        return ((atomic<uint32_t>*)(getSlab(id) + HEADER_BYTES))[id % OBJECTS_PER_SLAB];
+    }
+
+    uint32_t addSlab() {
+        uint32_t number = slabCount.load();
+        char *slab = number < MAX_SLABS ? (char*)aligned_alloc(SLAB_BYTES, SLAB_BYTES) : NULL;
+        if (slab == NULL)
+            throw bad_alloc();
+
+        *(uint32_t*)slab = number;
+        for (uint32_t i=0; i<OBJECTS_PER_SLAB; i++)
+            new (slab + HEADER_BYTES + i * sizeof(uint32_t)) atomic<uint32_t>(IndexStack::NIL);
+        slabs[number].store(slab, memory_order_release);
+        slabCount = number + 1;
+
+        auto links = [this](uint32_t id) -> atomic<uint32_t>& { return getLink(id); };
+        for (uint32_t i=OBJECTS_PER_SLAB-1; i>0; i--)
+            freeList.push(number * OBJECTS_PER_SLAB + i, links);
+        return number * OBJECTS_PER_SLAB;
+    }
+
+public:
+    ObjectPool() {
+        this->slabs.reset(new atomic<char*>[MAX_SLABS]());
+    }
+
+    ~ObjectPool() {
+        for (uint32_t i=0; i<slabCount; i++)
+            free(slabs[i].load());
+    }
+
+    static ObjectPool& getInstance() {
+        static ObjectPool pool;
+        return pool;
+    }
+
+    /* Id of a free slot, the object has to be built with construct() */
+    uint32_t allocate() {
+        auto links = [this](uint32_t id) -> atomic<uint32_t>& { return getLink(id); };
+        uint32_t id = freeList.pop(links);
+        if (id == IndexStack::NIL) {
+            lock_guard<mutex> lock(growMutex);
+            id = freeList.pop(links);
+            if (id == IndexStack::NIL)
+                id = addSlab();
+        }
+        liveCount++;
+        return id;
+    }
+
+    template <typename... Args>
+    T* construct(uint32_t id, Args&&... args) {
+        return new (get(id)) T(forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        return construct(allocate(), forward<Args>(args)...);
+    }
+
+    void release(T *object) {
+        uint32_t id = getId(object);
+        object->~T();
+        freeList.push(id, [this](uint32_t id) -> atomic<uint32_t>& { return getLink(id); });
+        liveCount--;
+    }
+
+    /* Releases a batch of objects with a single push onto the free list */
+    void release(T *const *objects, size_t count) {
+        if (count == 0)
+            return;
+        uint32_t first = getId(objects[0]), last = first;
+        objects[0]->~T();
+        for (size_t i=1; i<count; i++) {
+            uint32_t id = getId(objects[i]);
+            objects[i]->~T();
+            getLink(last).store(id, memory_order_relaxed);
+            last = id;
+        }
+        freeList.pushChain(first, last, [this](uint32_t id) -> atomic<uint32_t>& { return getLink(id); });
+        liveCount -= count;
+    }
+
+    T* get(uint32_t id) {
+        return (T*)(getSlab(id) + OBJECTS_OFFSET) + id % OBJECTS_PER_SLAB;
+    }
+
+    uint32_t getId(const T *object) {
+        char *slab = (char*)((uintptr_t)object & ~(uintptr_t)(SLAB_BYTES - 1));
+        return *(uint32_t*)slab * OBJECTS_PER_SLAB + (uint32_t)(object - (T*)(slab + OBJECTS_OFFSET));
+    }
+
+    long long getLiveCount() {
+        return liveCount.load();
+    }
+
+    size_t getSlabCount() {
+        return slabCount.load();
+    }
+};
+
 /* =========================================================== */
 /* ==================== Parking Lot Design =================== */
 /* =========================================================== */
@@ -14,6 +198,8 @@ enum ParkingSpotType
     XLARGE
 };
 
+const int PARKING_SPOT_TYPE_COUNT = 4;
+
 /* Vehicle types that are allowed in the parking lot */
 enum VehicleType {
     CAR,
@@ -39,6 +225,30 @@ public:
     VehicleType getType() {
         return vehicleType;
     }
+
+    string getLicensePlateNumber() {
+        return licensePlateNumber;
+    }
+};
+
+/* Vehicles come & go all day, so they are created in and released back to a pool instead of the heap */
+class VehicleFactory
+{
+public:
+    static Vehicle* createVehicle(string licensePlateNumber, VehicleType vehicleType) {
+        return ObjectPool<Vehicle>::getInstance().create(licensePlateNumber, vehicleType);
+    }
+
+    static void releaseVehicle(Vehicle *vehicle) {
+        ObjectPool<Vehicle>::getInstance().release(vehicle);
+    }
+};
+
+/* Position on a floor, in meters from the corner of the floor */
+struct Position
+{
+    float x;
+    float y;
 };
 
 /* Parking Spot is a basic entity that contains properties like whether the spot is available
@@ -49,13 +259,15 @@ class ParkingSpot
     int floorId;
     ParkingSpotType spotType;
     bool isAvailable;
+    Position position;
 
 public:
-    ParkingSpot(int floorId, int spotId, ParkingSpotType spotType)
+    ParkingSpot(int floorId, int spotId, ParkingSpotType spotType, Position position = Position())
     {
         this->floorId = floorId;
         this->spotId = spotId;
         this->spotType = spotType;
+        this->position = position;
         isAvailable = true;
     }
     
@@ -63,6 +275,10 @@ public:
         this->isAvailable = isAvailable;
     }
 
+    bool getAvailability() {
+        return isAvailable;
+    }
+
     int getSpotId() {
         return spotId;
     }
@@ -74,20 +290,24 @@ public:
     ParkingSpotType getSpotType() {
         return spotType;
     }
+
+    Position getPosition() {
+        return position;
+    }
 };
 
 /* Parking Ticket is a composition entity that maps vehicle to a parking spot
     and is issued at the entry panel */
 class ParkingTicket
 {
-    int ticketNumber;
+    int64_t ticketNumber;
     int issuedAt;
     int charges;
     ParkingSpot *allocatedSpot;
     Vehicle *vehicle;
 
 public:
-    void setTicketNumber(int ticketNumber) {
+    void setTicketNumber(int64_t ticketNumber) {
         this->ticketNumber = ticketNumber;
     }
     
@@ -123,14 +343,14 @@ public:
         return charges;
     }
     
-    int getTicketNumber() {
+    int64_t getTicketNumber() {
         return ticketNumber;
     }
 };
 
 class EntrancePanel;
 class ExitPanel;
-class ParkingFloor;
+class ParkingJournal;
 
 /* The strategy with which the vehicles are assigned a parking spot can vary
 Say, on weekends we deploy strategy that allots spots near to the elevator or
@@ -138,254 +358,3526 @@ on weekdays we allot slots near to entry / exit gates. So we use Strategy Patter
 class ParkingStrategy
 {
 public:
-    virtual void addParkingSpot(int floorId, ParkingSpotType spotType) = 0;
+    /* Slots added straight to a strategy are counted on the occupancy board of a lot when the strategy is set on it,
+    slots added later have to go through ParkingLot::addParkingSpots */
+    virtual ParkingSpot* addParkingSpot(int floorId, ParkingSpotType spotType, Position position = Position()) = 0;
+    /* Adds a slot which may already be occupied, used to rebuild the lot from its journal */
+    virtual ParkingSpot* restoreParkingSpot(int floorId, ParkingSpotType spotType, Position position, bool isAvailable) = 0;
 
     virtual ParkingSpot* getParkingSpot(ParkingSpotType spotType) = 0;
+    /* Slot for a vehicle coming in through a gate at the given floor & position, strategies which don't mind where the
+    vehicle comes from ignore it */
+    virtual ParkingSpot* getParkingSpot(ParkingSpotType spotType, int /* floorId */, Position /* position */) {
+        return getParkingSpot(spotType);
+    }
+    /* Registers a gate vehicles come in through, strategies allotting by distance prepare their order of the slots for
+    it right away instead of on the first vehicle. Every EntrancePanel registers its own gate. */
+    virtual void addGate(int /* floorId */, Position /* position */) {}
+    /* Brings the orders prepared for the gates up to date with the slots added since, ParkingLot calls it once per batch
+    of slots added */
+    virtual void updateGates() {}
     virtual void vacateParkingSpot(ParkingSpot *parkingSpot) = 0;
-    virtual bool isParkingSpotAvailable(ParkingSpotType spotType) = 0;
-};
-
-class Compare {
-public:
-    bool operator()(ParkingSpot *p1, ParkingSpot *p2)
-    {
-        return p1->getSpotId() > p2->getSpotId();
+    /* Vacates a batch of slots, strategies which can put them back in bulk override it */
+    virtual void vacateParkingSpots(ParkingSpot *const *parkingSpots, size_t count) {
+        for (size_t i=0; i<count; i++)
+            vacateParkingSpot(parkingSpots[i]);
     }
+    virtual bool isParkingSpotAvailable(ParkingSpotType spotType) = 0;
+    /* Appends every slot of the strategy, available or not */
+    virtual void getParkingSpots(vector<ParkingSpot*> &parkingSpots) = 0;
+    virtual ~ParkingStrategy() {}
 };
 
-/* Allots first available slot on the basis of slotNumber preferably on the lowest floor possible */
+/* Allots first available slot on the basis of slotNumber preferably on the lowest floor possible.
+Besides the available slots of every floor it keeps, per spot type, the ordered set of floors which have at least one
+available slot, so the lowest floor is the first element of the set: allotting or vacating a slot is O(log F + log S)
+and checking availability is O(1) instead of a walk over all the floors.
+Slots are allocated from the ParkingSpot pool and the queues hold their ids, which are also their slot numbers. */
 class NormalParkingStrategy: public ParkingStrategy
 {
-    std::map<int, std::map<ParkingSpotType,
-        priority_queue<ParkingSpot*, std::vector<ParkingSpot*>, Compare>>> slots; // floor -> (spotType -> available slots mapping)
+    typedef priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> SpotQueue;
+
+    std::unordered_map<int, std::array<SpotQueue, PARKING_SPOT_TYPE_COUNT>> slots; // floor -> (spotType -> available slots mapping)
+    std::set<int> freeFloors[PARKING_SPOT_TYPE_COUNT];                            // spotType -> floors with available slots
+    std::vector<uint32_t> spotIds;                                                // all the slots, released with the strategy
+    ObjectPool<ParkingSpot> &spotPool = ObjectPool<ParkingSpot>::getInstance();
+
+    void pushParkingSpot(ParkingSpot *parkingSpot) {
+        SpotQueue &queue = slots[parkingSpot->getFloorId()][parkingSpot->getSpotType()];
+        queue.push(parkingSpot->getSpotId());
+        if (queue.size() == 1)
+            freeFloors[parkingSpot->getSpotType()].insert(parkingSpot->getFloorId());
+    }
 
 public:
-    void addParkingSpot(int floorId, ParkingSpotType spotType) {
-        ParkingSpot* parkingSpot = new ParkingSpot(floorId, time(NULL), spotType);
-        slots[floorId][spotType].push(parkingSpot);
+    ~NormalParkingStrategy() {
+        for (uint32_t spotId: spotIds)
+            spotPool.release(spotPool.get(spotId));
+    }
+
+    ParkingSpot* addParkingSpot(int floorId, ParkingSpotType spotType, Position position = Position()) {
+        return restoreParkingSpot(floorId, spotType, position, true);
+    }
+
+    ParkingSpot* restoreParkingSpot(int floorId, ParkingSpotType spotType, Position position, bool isAvailable) {
+        uint32_t spotId = spotPool.allocate();
+        ParkingSpot* parkingSpot = spotPool.construct(spotId, floorId, spotId, spotType, position);
+        spotIds.push_back(spotId);
+        if (isAvailable)
+            pushParkingSpot(parkingSpot);
+        else
+            parkingSpot->setAvailability(false);
+        return parkingSpot;
     }
 
     ParkingSpot* getParkingSpot(ParkingSpotType spotType) {
-        for (auto floor : slots)
-        {
-            if (floor.second[spotType].size() > 0) {
-                ParkingSpot* parkingSpot = floor.second[spotType].top();
-                slots[floor.first][spotType].pop();
+        if (freeFloors[spotType].empty())
+            return NULL; // no available slots
 
-                parkingSpot->setAvailability(false);
+        int floorId = *freeFloors[spotType].begin();
+        SpotQueue &queue = slots[floorId][spotType];
+        ParkingSpot* parkingSpot = spotPool.get(queue.top());
+        queue.pop();
+        if (queue.empty())
+            freeFloors[spotType].erase(freeFloors[spotType].begin());
 
-                return parkingSpot;
-            }
-        }
-        
-        return NULL; // no available slots
+        parkingSpot->setAvailability(false);
+
+        return parkingSpot;
     }
 
     void vacateParkingSpot(ParkingSpot *parkingSpot) {
         parkingSpot->setAvailability(true);
-        slots[parkingSpot->getFloorId()][parkingSpot->getSpotType()].push(parkingSpot);
+        pushParkingSpot(parkingSpot);
+    }
+
+    /* Looks up the queues of a floor once for every run of slots on the same floor, ParkingLot hands batches over
+    sorted by floor */
+    void vacateParkingSpots(ParkingSpot *const *parkingSpots, size_t count) {
+        std::array<SpotQueue, PARKING_SPOT_TYPE_COUNT> *floorSlots = NULL;
+        int floorId = 0;
+        for (size_t i=0; i<count; i++) {
+            ParkingSpot *parkingSpot = parkingSpots[i];
+            if (floorSlots == NULL || parkingSpot->getFloorId() != floorId) {
+                floorId = parkingSpot->getFloorId();
+                floorSlots = &slots[floorId];
+            }
+
+            parkingSpot->setAvailability(true);
+            SpotQueue &queue = (*floorSlots)[parkingSpot->getSpotType()];
+            queue.push(parkingSpot->getSpotId());
+            if (queue.size() == 1)
+                freeFloors[parkingSpot->getSpotType()].insert(floorId);
+        }
     }
 
     bool isParkingSpotAvailable(ParkingSpotType spotType)
     {
-        for (auto floor: slots)
-            if (floor.second[spotType].size() > 0)
-                return true;
+        return !freeFloors[spotType].empty();
+    }
 
-        return false;
+    void getParkingSpots(vector<ParkingSpot*> &parkingSpots) {
+        for (uint32_t spotId: spotIds)
+            parkingSpots.push_back(spotPool.get(spotId));
     }
 };
 
-/* Helper method to get parking spot type from given vehicle type */
-ParkingSpotType getSpotTypeFromVehicleType(VehicleType vehicleType)
+/* Allots slots to gates running on their own threads without any lock. The available slots of every spot type are
+spread over SHARDS lock free index stacks (a gate starts with its own shard and takes from the others once it is empty), and
+every slot has an atomic FREE / OCCUPIED state, so popping a slot off a stack checks & claims it in one step and a slot
+vacated twice is only put back once. Slots live in one preallocated array, a slot's number is its index in the array.
+Unlike NormalParkingStrategy it does not prefer the lowest floor, any free slot of the right type may be allotted. */
+class ConcurrentParkingStrategy: public ParkingStrategy
 {
-    ParkingSpotType spotType = ParkingSpotType::SMALL;
-        
-    switch (vehicleType)
-    {
-        case VehicleType::MotorBike:
-            spotType = ParkingSpotType::SMALL;
-            break;
-        case VehicleType::CAR:
-            spotType = ParkingSpotType::MEDIUM;
-            break;
-        case VehicleType::TRUCK:
-            spotType = ParkingSpotType::LARGE;
-            break;
-        default:
-            spotType = ParkingSpotType::XLARGE;
-            break;
-    }
-    
-    return spotType;
-}
+    static const int SHARDS = 8;
 
-/* Main entity for this problem statement. We are using singleton design pattern to have support of only one instance throughout the deployment.
-If we want, we can alter the design to have multiple instances and would need to add corresponding functionality to handle mutiple parking lots */
-class ParkingLot
-{
-    int id;
-    string address;
-    vector<ParkingFloor*> parkingFloors;
-    vector<EntrancePanel*> entryPanels;
-    vector<ExitPanel*> exitPanels;
+    enum SpotState: uint8_t { FREE, OCCUPIED };
 
-    ParkingLot(int id) {
-        this->id = id;
+    size_t capacity;
+    ParkingSpot *spots;
+    unique_ptr<atomic<uint32_t>[]> next;
+    unique_ptr<atomic<uint8_t>[]> states;
+    atomic<uint32_t> spotCount{0};
+    IndexStack freeLists[PARKING_SPOT_TYPE_COUNT][SHARDS];
+
+    static int getShard() {
+        static atomic<int> nextShard{0};
+        thread_local int shard = nextShard++ % SHARDS;
+        return shard;
     }
 
-    ParkingLot(ParkingLot &a) {};
-    static ParkingLot* instance;
+    atomic<uint32_t>& getLink(uint32_t index) {
+        return next[index];
+    }
 
 public:
-    NormalParkingStrategy parkingStrategy;
+    ConcurrentParkingStrategy(size_t capacity = 1 << 20) {
+        this->capacity = capacity;
+        this->spots = (ParkingSpot*)::operator new(capacity * sizeof(ParkingSpot));
+        this->next.reset(new atomic<uint32_t>[capacity]);
+        this->states.reset(new atomic<uint8_t>[capacity]);
+    }
 
-    static ParkingLot* getInstance();
+    ~ConcurrentParkingStrategy() {
+        for (size_t i=0; i<getSpotCount(); i++)
+            spots[i].~ParkingSpot();
+        ::operator delete(spots);
+    }
 
-    void setAddress(string address) {
-        this->address = address;
+    /* Can be called while gates are running, the slot becomes available once it is added */
+    ParkingSpot* addParkingSpot(int floorId, ParkingSpotType spotType, Position position = Position()) {
+        return restoreParkingSpot(floorId, spotType, position, true);
     }
 
-    int addParkingFloor(ParkingFloor *floor) {
-        parkingFloors.push_back(floor);
-        return 0;
+    ParkingSpot* restoreParkingSpot(int floorId, ParkingSpotType spotType, Position position, bool isAvailable) {
+        uint32_t index = spotCount.fetch_add(1);
+        if (index >= capacity)
+            throw runtime_error("parking strategy is full, capacity is " + to_string(capacity) + " slots");
+
+        new (&spots[index]) ParkingSpot(floorId, index, spotType, position);
+        if (isAvailable) {
+            states[index].store(FREE, memory_order_relaxed);
+            freeLists[spotType][index % SHARDS].push(index, [this](uint32_t i) -> atomic<uint32_t>& { return getLink(i); });
+        } else {
+            states[index].store(OCCUPIED, memory_order_relaxed);
+            spots[index].setAvailability(false);
+        }
+        return &spots[index];
     }
 
-    int addEntryPanel(EntrancePanel *entryPanel) {
-        entryPanels.push_back(entryPanel);
-        return 0;
-    } 
+    ParkingSpot* getParkingSpot(ParkingSpotType spotType) {
+        int shard = getShard();
+        for (int i=0; i<SHARDS; i++) {
+            uint32_t index = freeLists[spotType][(shard + i) % SHARDS].pop([this](uint32_t i) -> atomic<uint32_t>& { return getLink(i); });
+            if (index == IndexStack::NIL)
+                continue;
+
+            states[index].store(OCCUPIED, memory_order_relaxed);
+            spots[index].setAvailability(false);
+            return &spots[index];
+        }
 
-    int addExitPanel(ExitPanel *exitPanel) {
-        exitPanels.push_back(exitPanel);
-        return 0;
+        return NULL; // no available slots
     }
 
-    bool canPark(VehicleType vehicleType) {
-        return parkingStrategy.isParkingSpotAvailable(getSpotTypeFromVehicleType(vehicleType));
+    void vacateParkingSpot(ParkingSpot *parkingSpot) {
+        uint32_t index = parkingSpot->getSpotId();
+        uint8_t expected = OCCUPIED;
+        if (!states[index].compare_exchange_strong(expected, FREE))
+            return; // already vacated
+
+        parkingSpot->setAvailability(true);
+        freeLists[parkingSpot->getSpotType()][getShard()].push(index, [this](uint32_t i) -> atomic<uint32_t>& { return getLink(i); });
     }
-};
 
-ParkingLot* ParkingLot::instance = NULL;
+    /* The slots of every spot type are linked into a chain and pushed onto the gate's shard with a single CAS */
+    void vacateParkingSpots(ParkingSpot *const *parkingSpots, size_t count) {
+        uint32_t first[PARKING_SPOT_TYPE_COUNT], last[PARKING_SPOT_TYPE_COUNT];
+        fill(first, first + PARKING_SPOT_TYPE_COUNT, IndexStack::NIL);
+        for (size_t i=0; i<count; i++) {
+            uint32_t index = parkingSpots[i]->getSpotId();
+            uint8_t expected = OCCUPIED;
+            if (!states[index].compare_exchange_strong(expected, FREE))
+                continue; // already vacated
+
+            parkingSpots[i]->setAvailability(true);
+            int spotType = parkingSpots[i]->getSpotType();
+            if (first[spotType] == IndexStack::NIL)
+                last[spotType] = index;
+            else
+                next[index].store(first[spotType], memory_order_relaxed);
+            first[spotType] = index;
+        }
 
-ParkingLot* ParkingLot::getInstance()
-{
-    if (instance == NULL)
-        instance = new ParkingLot(1);
+        int shard = getShard();
+        for (int spotType=0; spotType<PARKING_SPOT_TYPE_COUNT; spotType++) {
+            if (first[spotType] != IndexStack::NIL)
+                freeLists[spotType][shard].pushChain(first[spotType], last[spotType], [this](uint32_t i) -> atomic<uint32_t>& { return getLink(i); });
+        }
+    }
 
-    return instance;
-}
+    /* A snapshot only, use getParkingSpot to check & claim a slot at once */
+    bool isParkingSpotAvailable(ParkingSpotType spotType) {
+        for (int i=0; i<SHARDS; i++) {
+            if (!freeLists[spotType][i].isEmpty())
+                return true;
+        }
+        return false;
+    }
 
-/* Entrance Panel is where user gets the parking ticket and spot gets allocated */
-class EntrancePanel
-{
-    int id;
+    size_t getSpotCount() {
+        return min((size_t)spotCount.load(), capacity);
+    }
 
-public:
-    EntrancePanel(int id) {
-        this->id = id;
+    ParkingSpot* getSpot(size_t index) {
+        return &spots[index];
     }
 
-    ParkingTicket* getParkingTicket(Vehicle *vehicle) {
-        if (!ParkingLot::getInstance()->canPark(vehicle->getType()))
-            return NULL;
-        
-        ParkingSpotType spotType = getSpotTypeFromVehicleType(vehicle->getType());
-        ParkingSpot* parkingSpot = ParkingLot::getInstance()->parkingStrategy.getParkingSpot(spotType);
-        if (parkingSpot == NULL) return NULL;
-        
-        /* Builder design pattern used when constructing Parking Ticket */
-        ParkingTicket *parkingTicket = new ParkingTicket();
-        parkingTicket->setIssuedAt(time(NULL));
-        parkingTicket->setAllocatedSpot(parkingSpot);
-        parkingTicket->setVehicle(vehicle);
-        parkingTicket->setTicketNumber(time(NULL));
-        return parkingTicket;
+    void getParkingSpots(vector<ParkingSpot*> &parkingSpots) {
+        for (size_t i=0; i<getSpotCount(); i++)
+            parkingSpots.push_back(&spots[i]);
     }
 };
 
-/* Exit Panel scans the parking ticket, vacate the spot and calculates the parking charges */
-class ExitPanel
+/* Static 2-d tree over the slots of one floor & spot type, kept in an array: the node of a range is its middle slot, the
+range is split on x at even depths & on y at odd ones, down to leaves of at most LEAF_SIZE slots which are scanned. Every
+range counts its free slots, so taking or freeing a slot only updates the counts on the path to it, and the nearest free
+slot search skips the ranges without any as well as the ones farther than the best slot found so far.
+Slots are added at configuration time, the tree is rebuilt by the first search after an add. */
+class SpotTree
 {
-    int id;
-    std::unordered_map<ParkingSpotType, int> hourlyCosts;
+    static const int LEAF_SIZE = 8;
 
-    int calculateCost(ParkingTicket *parkingTicket) {
-        int duration = time(NULL) - parkingTicket->getIssuedAt();
-        
-        int hours = duration / (60 * 60);
-        if (hours == 0) hours = 1;
-        
-        return hours * hourlyCosts[parkingTicket->getAllocatedSpot()->getSpotType()];
+    struct Slot {
+        Position position;
+        uint32_t spotId;
+        uint32_t isFree;
+    };
+
+    vector<Slot> slots;       // in tree order
+    vector<int> freeCounts;   // free slots of the range whose middle is the index
+    int freeCount = 0;
+    bool isBuilt = true;
+
+    static float getCoordinate(const Slot &slot, int depth) {
+        return depth % 2 == 0 ? slot.position.x : slot.position.y;
+    }
+
+    void sortRange(int lo, int hi, int depth) {
+        if (hi - lo <= LEAF_SIZE)
+            return;
+        int mid = (lo + hi) / 2;
+        nth_element(slots.begin() + lo, slots.begin() + mid, slots.begin() + hi, [depth](const Slot &a, const Slot &b) {
+            return getCoordinate(a, depth) < getCoordinate(b, depth);
+        });
+        sortRange(lo, mid, depth + 1);
+        sortRange(mid + 1, hi, depth + 1);
+    }
+
+    int countRange(int lo, int hi) {
+        if (lo >= hi)
+            return 0;
+        int mid = (lo + hi) / 2;
+        if (hi - lo <= LEAF_SIZE) {
+            freeCounts[mid] = 0;
+            for (int i=lo; i<hi; i++)
+                freeCounts[mid] += slots[i].isFree;
+        } else {
+            freeCounts[mid] = countRange(lo, mid) + countRange(mid + 1, hi) + slots[mid].isFree;
+        }
+        return freeCounts[mid];
+    }
+
+    static float getDistance(Position from, Position to) {
+        float dx = to.x - from.x, dy = to.y - from.y;
+        return dx * dx + dy * dy;
     }
 
 public:
-    ExitPanel(int id)
-    {
-        this->id = id;
-        hourlyCosts.insert({ParkingSpotType::SMALL, 10});
-        hourlyCosts.insert({ParkingSpotType::MEDIUM, 20});
-        hourlyCosts.insert({ParkingSpotType::LARGE, 30});
-        hourlyCosts.insert({ParkingSpotType::XLARGE, 50});
+    /* Returns the index of the slot in the tree, treeIndexes (by spot id) is kept up to date when the tree is rebuilt */
+    uint32_t add(uint32_t spotId, Position position, bool isAvailable) {
+        slots.push_back(Slot{position, spotId, isAvailable});
+        freeCount += isAvailable;
+        isBuilt = false;
+        return slots.size() - 1;
     }
 
-    ParkingTicket* scanAndVacate(ParkingTicket *parkingTicket) {
-        parkingTicket->setCharges(calculateCost(parkingTicket));
-        ParkingLot::getInstance()->parkingStrategy.vacateParkingSpot(parkingTicket->getAllocatedSpot());
-        return parkingTicket;
+    void build(vector<uint32_t> &treeIndexes) {
+        sortRange(0, slots.size(), 0);
+        for (size_t i=0; i<slots.size(); i++)
+            treeIndexes[slots[i].spotId] = i;
+        freeCounts.assign(slots.size(), 0);
+        countRange(0, slots.size());
+        isBuilt = true;
+    }
+
+    void setFree(uint32_t index, bool isAvailable) {
+        if (slots[index].isFree == isAvailable)
+            return;
+        int change = isAvailable ? 1 : -1;
+        slots[index].isFree = isAvailable;
+        freeCount += change;
+        if (!isBuilt)
+            return; // counted by the next build
+
+        int lo = 0, hi = slots.size();
+        while (true) {
+            int mid = (lo + hi) / 2;
+            freeCounts[mid] += change;
+            if ((int)index == mid || hi - lo <= LEAF_SIZE)
+                break;
+            if ((int)index < mid)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+    }
+
+    /* Index of the free slot nearest to from whose squared distance is below maxDistance, or -1 */
+    int findNearest(Position from, float maxDistance, vector<uint32_t> &treeIndexes, float &distance) {
+        if (!isBuilt)
+            build(treeIndexes);
+
+        // ranges left to search with the box their slots lie in
+        struct Range {
+            int lo, hi, depth;
+            Position low, high;
+        };
+        Range stack[64];
+        float infinity = numeric_limits<float>::infinity();
+        int size = 0, bestIndex = -1;
+        stack[size++] = Range{0, (int)slots.size(), 0, Position{-infinity, -infinity}, Position{infinity, infinity}};
+        distance = maxDistance;
+
+        while (size > 0) {
+            Range range = stack[--size];
+            int mid = (range.lo + range.hi) / 2;
+            if (range.lo >= range.hi || freeCounts[mid] == 0)
+                continue;
+            float boxX = max(max(range.low.x - from.x, from.x - range.high.x), 0.0f);
+            float boxY = max(max(range.low.y - from.y, from.y - range.high.y), 0.0f);
+            if (boxX * boxX + boxY * boxY >= distance)
+                continue;
+
+            if (range.hi - range.lo <= LEAF_SIZE) {
+                for (int i=range.lo; i<range.hi; i++) {
+                    float slotDistance = getDistance(from, slots[i].position);
+                    if (slots[i].isFree && slotDistance < distance) {
+                        distance = slotDistance;
+                        bestIndex = i;
+                    }
+                }
+                continue;
+            }
+
+            if (slots[mid].isFree && getDistance(from, slots[mid].position) < distance) {
+                distance = getDistance(from, slots[mid].position);
+                bestIndex = mid;
+            }
+
+            // the far side goes on the stack first so that the near side is searched first
+            float split = getCoordinate(slots[mid], range.depth);
+            Range lower = range, upper = range;
+            lower.hi = mid;
+            upper.lo = mid + 1;
+            lower.depth = upper.depth = range.depth + 1;
+            (range.depth % 2 == 0 ? lower.high.x : lower.high.y) = split;
+            (range.depth % 2 == 0 ? upper.low.x : upper.low.y) = split;
+            bool isLowerNear = (range.depth % 2 == 0 ? from.x : from.y) < split;
+            stack[size++] = isLowerNear ? upper : lower;
+            stack[size++] = isLowerNear ? lower : upper;
+        }
+        return bestIndex;
+    }
+
+    int getFreeCount() {
+        return freeCount;
+    }
+
+    uint32_t getSpotId(uint32_t index) {
+        return slots[index].spotId;
     }
 };
 
-/* Floor keeps track of slots that are on the particular floor.
-We don't need parking strategy here as the it seems more logical to be part of the parking lot. */
-class ParkingFloor
+/* The slots of a lot ranked by their distance from one gate, per spot type, with a bitmap of the free slots by rank and
+a summary bit per word of the bitmap telling whether the word has any free slot. The nearest free slot is the first bit
+set, found with a scan of the summary & two bit scans whatever the occupancy. */
+class GateOrder
 {
     int floorId;
-    std::unordered_map<int, ParkingSpot*> occupiedSlots; // slotNumber to ParkingSpot mapping for occupied spots
+    Position position;
+    vector<uint32_t> spotIds[PARKING_SPOT_TYPE_COUNT];   // by rank
+    vector<uint64_t> words[PARKING_SPOT_TYPE_COUNT];     // free slots by rank
+    vector<uint64_t> summary[PARKING_SPOT_TYPE_COUNT];   // words with a free slot
+    vector<uint32_t> ranks;                              // spot id -> rank among the slots of its type
 
 public:
-    ParkingFloor(int id) {
-        this->floorId = id;
+    /* slots are all the slots of the lot, costs the distance from the gate to each one */
+    GateOrder(int floorId, Position position, vector<ParkingSpot*> &slots, function<float(ParkingSpot*)> getCost) {
+        this->floorId = floorId;
+        this->position = position;
+
+        vector<pair<float, ParkingSpot*>> ranked;
+        for (ParkingSpot *parkingSpot: slots)
+            ranked.push_back({getCost(parkingSpot), parkingSpot});
+        sort(ranked.begin(), ranked.end(), [](const pair<float, ParkingSpot*> &a, const pair<float, ParkingSpot*> &b) {
+            return a.first != b.first ? a.first < b.first : a.second->getSpotId() < b.second->getSpotId();
+        });
+
+        for (auto &slot: ranked) {
+            uint32_t spotId = slot.second->getSpotId();
+            vector<uint32_t> &typeSpotIds = spotIds[slot.second->getSpotType()];
+            if (ranks.size() <= spotId)
+                ranks.resize(spotId + 1);
+            ranks[spotId] = typeSpotIds.size();
+            typeSpotIds.push_back(spotId);
+        }
+        for (int i=0; i<PARKING_SPOT_TYPE_COUNT; i++) {
+            words[i].assign(spotIds[i].size() / 64 + 1, 0);
+            summary[i].assign(words[i].size() / 64 + 1, 0);
+        }
+        for (auto &slot: ranked)
+            setFree(slot.second, slot.second->getAvailability());
     }
 
-    void markParkingSpot(ParkingSpot* parkingSpot) {
-        occupiedSlots[parkingSpot->getSpotId()] = parkingSpot;
+    bool isAt(int floorId, Position position) {
+        return this->floorId == floorId && this->position.x == position.x && this->position.y == position.y;
     }
 
-    void vacateParkingSpot(int spotId) {
-        occupiedSlots.erase(spotId);
+    int getFloorId() {
+        return floorId;
     }
-};
 
-/* Payment processor is used to pay parking charges. It can also have different payment strategies
-like Credit Card, Debit Card, UPI, ... */
-class Payment
-{
-    int id;
-    int ticketId;
-    int amount;
-    int initiatedAt;
-    int completedAt;
+    Position getPosition() {
+        return position;
+    }
 
-public:
-    Payment(int id, int ticketId, int amount) {
-        this->id = id;
-        this->ticketId = ticketId;
-        this->amount = amount;
+    void setFree(ParkingSpot *parkingSpot, bool isAvailable) {
+        int spotType = parkingSpot->getSpotType();
+        uint32_t rank = ranks[parkingSpot->getSpotId()];
+        uint64_t &word = words[spotType][rank / 64];
+        if (isAvailable)
+            word |= 1ULL << (rank % 64);
+        else
+            word &= ~(1ULL << (rank % 64));
+
+        uint64_t bit = 1ULL << (rank / 64 % 64);
+        if (word != 0)
+            summary[spotType][rank / 4096] |= bit;
+        else
+            summary[spotType][rank / 4096] &= ~bit;
     }
 
-    void makePayment() {
-        this->initiatedAt = time(NULL);
-        cout << "Payment made successfully of Rs. " << amount << endl;
-        this->completedAt = time(NULL);
+    /* Spot id of the nearest free slot, there must be one */
+    uint32_t getNearest(ParkingSpotType spotType) {
+        size_t group = 0;
+        while (summary[spotType][group] == 0)
+            group++;
+        size_t word = group * 64 + __builtin_ctzll(summary[spotType][group]);
+        return spotIds[spotType][word * 64 + __builtin_ctzll(words[spotType][word])];
     }
 };
 
-/* Driver function */
-int main()
+/* Allots the free slot nearest to the gate the vehicle comes in through, e.g. near the entry / exit gates on weekdays or
+near the elevator on weekends when the "gate" is the elevator. The distance to a slot is the straight line distance on its
+floor plus floorDistance meters for every floor between the gate & the slot.
+Every floor keeps a SpotTree per spot type, searched outwards from the gate's floor until the next floor is farther than
+the best slot found. A lot has only a few gates though, so for up to MAX_GATES gates registered with addGate the strategy
+also keeps a GateOrder and answers from it instead. Slots added later are searched in the trees only until updateGates
+rebuilds the orders, so no vehicle ever waits for an order to be built. */
+class NearestParkingStrategy: public ParkingStrategy
 {
-    ParkingLot* parkingLot = ParkingLot::getInstance();
-    parkingLot->setAddress("Parking Lot, Phoenix Mall, Bengaluru, Karnataka");
+    static const int MAX_GATES = 8;
+
+    struct Floor {
+        int floorId;
+        SpotTree trees[PARKING_SPOT_TYPE_COUNT];
+    };
+
+    vector<unique_ptr<Floor>> floors;            // by floorId
+    unordered_map<int, Floor*> floorsById;
+    vector<uint32_t> treeIndexes;                // spot id -> index of the slot in its tree
+    vector<unique_ptr<GateOrder>> gates;
+    bool areGatesStale = false;                  // slots were added since the orders were built
+    vector<uint32_t> spotIds;                    // all the slots, released with the strategy
+    int freeCounts[PARKING_SPOT_TYPE_COUNT] = {};
+    float floorDistance;
+    ObjectPool<ParkingSpot> &spotPool = ObjectPool<ParkingSpot>::getInstance();
+
+    Floor* getFloor(int floorId) {
+        auto floor = floorsById.find(floorId);
+        if (floor != floorsById.end())
+            return floor->second;
+
+        auto position = lower_bound(floors.begin(), floors.end(), floorId, [](const unique_ptr<Floor> &floor, int floorId) {
+            return floor->floorId < floorId;
+        });
+        Floor *added = floors.insert(position, unique_ptr<Floor>(new Floor()))->get();
+        added->floorId = floorId;
+        floorsById[floorId] = added;
+        return added;
+    }
+
+    float getDistance(int floorId, Position position, ParkingSpot *parkingSpot) {
+        Position spotPosition = parkingSpot->getPosition();
+        float dx = spotPosition.x - position.x, dy = spotPosition.y - position.y;
+        return floorDistance * abs(parkingSpot->getFloorId() - floorId) + sqrt(dx * dx + dy * dy);
+    }
+
+    GateOrder* getGate(int floorId, Position position) {
+        if (areGatesStale)
+            return NULL;
+        for (auto &gate: gates) {
+            if (gate->isAt(floorId, position))
+                return gate.get();
+        }
+        return NULL;
+    }
+
+    GateOrder* buildGate(int floorId, Position position) {
+        vector<ParkingSpot*> slots;
+        getParkingSpots(slots);
+        return new GateOrder(floorId, position, slots, [&](ParkingSpot *parkingSpot) {
+            return getDistance(floorId, position, parkingSpot);
+        });
+    }
+
+    ParkingSpot* findNearest(ParkingSpotType spotType, int floorId, Position position) {
+        float bestDistance = numeric_limits<float>::infinity();
+        SpotTree *bestTree = NULL;
+        int bestIndex = -1;
+        int above = lower_bound(floors.begin(), floors.end(), floorId, [](const unique_ptr<Floor> &floor, int floorId) {
+            return floor->floorId < floorId;
+        }) - floors.begin();
+        int below = above - 1;
+        while (below >= 0 || above < (int)floors.size()) {
+            bool isAbove = below < 0 || (above < (int)floors.size() && floors[above]->floorId - floorId <= floorId - floors[below]->floorId);
+            Floor *floor = (isAbove ? floors[above++] : floors[below--]).get();
+            float floorCost = floorDistance * abs(floor->floorId - floorId);
+            if (floorCost >= bestDistance)
+                break; // every floor left is farther
+
+            SpotTree &tree = floor->trees[spotType];
+            if (tree.getFreeCount() == 0)
+                continue;
+            float remaining = bestDistance - floorCost, distance;
+            int index = tree.findNearest(position, remaining * remaining, treeIndexes, distance);
+            if (index >= 0) {
+                bestDistance = floorCost + sqrt(distance);
+                bestTree = &tree;
+                bestIndex = index;
+            }
+        }
+        return spotPool.get(bestTree->getSpotId(bestIndex));
+    }
+
+    void setFree(ParkingSpot *parkingSpot, bool isAvailable) {
+        parkingSpot->setAvailability(isAvailable);
+        floorsById[parkingSpot->getFloorId()]->trees[parkingSpot->getSpotType()].setFree(treeIndexes[parkingSpot->getSpotId()], isAvailable);
+        if (!areGatesStale) {
+            for (auto &gate: gates)
+                gate->setFree(parkingSpot, isAvailable);
+        }
+        freeCounts[parkingSpot->getSpotType()] += isAvailable ? 1 : -1;
+    }
+
+public:
+    NearestParkingStrategy(float floorDistance = 50) {
+        this->floorDistance = floorDistance;
+    }
+
+    ~NearestParkingStrategy() {
+        for (uint32_t spotId: spotIds)
+            spotPool.release(spotPool.get(spotId));
+    }
+
+    ParkingSpot* addParkingSpot(int floorId, ParkingSpotType spotType, Position position = Position()) {
+        return restoreParkingSpot(floorId, spotType, position, true);
+    }
+
+    ParkingSpot* restoreParkingSpot(int floorId, ParkingSpotType spotType, Position position, bool isAvailable) {
+        uint32_t spotId = spotPool.allocate();
+        ParkingSpot* parkingSpot = spotPool.construct(spotId, floorId, spotId, spotType, position);
+        parkingSpot->setAvailability(isAvailable);
+        spotIds.push_back(spotId);
+        if (treeIndexes.size() <= spotId)
+            treeIndexes.resize(spotId + 1);
+        treeIndexes[spotId] = getFloor(floorId)->trees[spotType].add(spotId, position, isAvailable);
+        freeCounts[spotType] += isAvailable;
+        areGatesStale = !gates.empty();
+        return parkingSpot;
+    }
+
+    /* Without a gate, the slot nearest to the corner of the lowest floor */
+    ParkingSpot* getParkingSpot(ParkingSpotType spotType) {
+        return getParkingSpot(spotType, floors.empty() ? 0 : floors[0]->floorId, Position());
+    }
+
+    ParkingSpot* getParkingSpot(ParkingSpotType spotType, int floorId, Position position) {
+        if (freeCounts[spotType] == 0)
+            return NULL; // no available slots
+
+        GateOrder *gate = getGate(floorId, position);
+        ParkingSpot *parkingSpot = gate != NULL ? spotPool.get(gate->getNearest(spotType)) : findNearest(spotType, floorId, position);
+        setFree(parkingSpot, false);
+        return parkingSpot;
+    }
+
+    void vacateParkingSpot(ParkingSpot *parkingSpot) {
+        setFree(parkingSpot, true);
+    }
+
+    bool isParkingSpotAvailable(ParkingSpotType spotType) {
+        return freeCounts[spotType] > 0;
+    }
+
+    void getParkingSpots(vector<ParkingSpot*> &parkingSpots) {
+        for (uint32_t spotId: spotIds)
+            parkingSpots.push_back(spotPool.get(spotId));
+    }
+
+    /* Gates past MAX_GATES are served from the trees */
+    void addGate(int floorId, Position position) {
+        for (auto &gate: gates) {
+            if (gate->isAt(floorId, position))
+                return;
+        }
+        if (gates.size() < MAX_GATES)
+            gates.emplace_back(buildGate(floorId, position));
+    }
+
+    void updateGates() {
+        if (!areGatesStale)
+            return;
+        for (auto &gate: gates)
+            gate.reset(buildGate(gate->getFloorId(), gate->getPosition()));
+        areGatesStale = false;
+    }
+};
+
+/* Picks the parking strategy by name, e.g. from the command line */
+class ParkingStrategyFactory
+{
+public:
+    static ParkingStrategy* createParkingStrategy(string name) {
+        if (name == "normal")
+            return new NormalParkingStrategy();
+        if (name == "nearest")
+            return new NearestParkingStrategy();
+        if (name == "concurrent")
+            return new ConcurrentParkingStrategy();
+        throw invalid_argument("unknown parking strategy " + name + ", expected normal, nearest or concurrent");
+    }
+};
+
+/* Helper method to get parking spot type from given vehicle type */
+ParkingSpotType getSpotTypeFromVehicleType(VehicleType vehicleType)
+{
+    ParkingSpotType spotType = ParkingSpotType::SMALL;
+        
+    switch (vehicleType)
+    {
+        case VehicleType::MotorBike:
+            spotType = ParkingSpotType::SMALL;
+            break;
+        case VehicleType::CAR:
+            spotType = ParkingSpotType::MEDIUM;
+            break;
+        case VehicleType::TRUCK:
+            spotType = ParkingSpotType::LARGE;
+            break;
+        default:
+            spotType = ParkingSpotType::XLARGE;
+            break;
+    }
+    
+    return spotType;
+}
+
+/* Floor keeps track of slots that are on the particular floor.
+We don't need parking strategy here as the it seems more logical to be part of the parking lot.
+Gates on their own threads mark & vacate slots of the same floor, so the slots are guarded by a lock. */
+class ParkingFloor
+{
+    int floorId;
+    std::unordered_set<int> occupiedSlots; // slotNumbers of the occupied spots
+    mutex floorMutex;
+
+public:
+    ParkingFloor(int id) {
+        this->floorId = id;
+    }
+
+    int getFloorId() {
+        return floorId;
+    }
+
+    void markParkingSpot(ParkingSpot* parkingSpot) {
+        lock_guard<mutex> lock(floorMutex);
+        occupiedSlots.insert(parkingSpot->getSpotId());
+    }
+
+    void vacateParkingSpot(int spotId) {
+        lock_guard<mutex> lock(floorMutex);
+        occupiedSlots.erase(spotId);
+    }
+
+    void vacateParkingSpots(ParkingSpot *const *parkingSpots, size_t count) {
+        lock_guard<mutex> lock(floorMutex);
+        for (size_t i=0; i<count; i++)
+            occupiedSlots.erase(parkingSpots[i]->getSpotId());
+    }
+
+    /* Forgets every occupied slot, the journal rebuilds them on recovery */
+    void vacateAllParkingSpots() {
+        lock_guard<mutex> lock(floorMutex);
+        occupiedSlots.clear();
+    }
+
+    size_t getOccupiedCount() {
+        lock_guard<mutex> lock(floorMutex);
+        return occupiedSlots.size();
+    }
+};
+
+/* Change of the occupancy of a floor & spot type, freeSpots is read when the change is polled */
+struct OccupancyChange
+{
+    int floorId;
+    ParkingSpotType spotType;
+    int freeSpots;
+};
+
+/* Occupancy of a floor at the time of a snapshot */
+struct FloorOccupancy
+{
+    int floorId;
+    int spotCounts[PARKING_SPOT_TYPE_COUNT];
+    int occupiedCounts[PARKING_SPOT_TYPE_COUNT];
+};
+
+/* Counts of the slots & of the occupied slots per floor & spot type, for the displays & the app asking "is there space?".
+The gates bump the counters as they allot & vacate, the readers load them and never touch the parking strategy or any lock
+of the gates. Every change is also published on a feed: a ring of FEED_CAPACITY entries, one 64 bit word per change
+holding the lap it was written in plus one (so that an entry claimed but not written yet never passes for a change),
+the floor & the spot type. Subscribers follow the feed at their own pace & read the counters of whatever changed, so
+they always end up with the latest counts. A subscriber lapped by the gates is told so and starts over from a snapshot. Floors are added before the gates start. A board costs little until used: the counters
+are allocated 64 floors at a time and the feed on the first subscription, so a lot without subscribers publishes nothing. */
+class OccupancyBoard
+{
+public:
+    static const int MAX_FLOORS = 1 << 12;
+    static const uint64_t FEED_CAPACITY = 1 << 16;
+
+private:
+    static const int FLOOR_BITS = 12;
+    static const int CHUNK_BITS = 6;
+    static const int LAP_SHIFT = 48;
+
+    struct alignas(64) Counters {
+        atomic<int> spotCounts[PARKING_SPOT_TYPE_COUNT];
+        atomic<int> occupiedCounts[PARKING_SPOT_TYPE_COUNT];
+        int floorId;
+    };
+
+    unique_ptr<Counters[]> floorChunks[MAX_FLOORS >> CHUNK_BITS];  // by floor index, 1 << CHUNK_BITS floors a chunk
+    unordered_map<int, int> floorIndexes;                          // floorId -> floor index
+    atomic<int> floorCount{0};
+    Counters lot = {};                                             // the whole lot
+
+    alignas(64) atomic<uint64_t> published{0};
+    atomic<atomic<uint64_t>*> feed{NULL};                          // NULL until the first subscription
+    unique_ptr<atomic<uint64_t>[]> feedEntries;
+    once_flag feedAllocated;
+
+    Counters& getFloor(int index) {
+        return floorChunks[index >> CHUNK_BITS][index & ((1 << CHUNK_BITS) - 1)];
+    }
+
+    static int getFreeSpots(Counters &counters, int spotType) {
+        return counters.spotCounts[spotType].load(memory_order_relaxed) - counters.occupiedCounts[spotType].load(memory_order_relaxed);
+    }
+
+    void update(int floorId, ParkingSpotType spotType, int spotDelta, int occupiedDelta) {
+        lot.spotCounts[spotType].fetch_add(spotDelta, memory_order_relaxed);
+        lot.occupiedCounts[spotType].fetch_add(occupiedDelta, memory_order_relaxed);
+
+        auto index = floorIndexes.find(floorId);
+        if (index == floorIndexes.end())
+            return; // a floor the lot doesn't know, only counted for the whole lot
+        Counters &floor = getFloor(index->second);
+        floor.spotCounts[spotType].fetch_add(spotDelta, memory_order_relaxed);
+        floor.occupiedCounts[spotType].fetch_add(occupiedDelta, memory_order_relaxed);
+
+        // Pairs with the fence of the first subscription: either the feed is seen here or that subscriber sees the
+        // counts of this change. Until then nothing is published and published stays 0.
+        atomic_thread_fence(memory_order_seq_cst);
+        atomic<uint64_t> *entries = feed.load(memory_order_relaxed);
+        if (entries == NULL)
+            return;
+        uint64_t sequence = published.fetch_add(1, memory_order_acq_rel);
+        uint64_t lap = (sequence / FEED_CAPACITY + 1) & 0xFFFF;
+        entries[sequence % FEED_CAPACITY].store(lap << LAP_SHIFT | (uint64_t)index->second << 2 | spotType, memory_order_release);
+    }
+
+public:
+    void addParkingFloor(int floorId) {
+        int index = floorCount.load(memory_order_relaxed);
+        if (floorIndexes.count(floorId))
+            return;
+        if (index == MAX_FLOORS)
+            throw runtime_error("occupancy board is full, at most " + to_string(MAX_FLOORS) + " floors");
+
+        auto &chunk = floorChunks[index >> CHUNK_BITS];
+        if (!chunk)
+            chunk.reset(new Counters[1 << CHUNK_BITS]());
+        getFloor(index).floorId = floorId;
+        floorIndexes[floorId] = index;
+        floorCount.store(index + 1, memory_order_release);
+    }
+
+    void addParkingSpots(int floorId, ParkingSpotType spotType, int count) {
+        update(floorId, spotType, count, 0);
+    }
+
+    void markParkingSpot(ParkingSpot *parkingSpot) {
+        update(parkingSpot->getFloorId(), parkingSpot->getSpotType(), 0, 1);
+    }
+
+    void vacateParkingSpot(ParkingSpot *parkingSpot) {
+        update(parkingSpot->getFloorId(), parkingSpot->getSpotType(), 0, -1);
+    }
+
+    /* Slots of a single floor, every spot type touched is updated & published once */
+    void vacateParkingSpots(int floorId, ParkingSpot *const *parkingSpots, size_t count) {
+        int vacated[PARKING_SPOT_TYPE_COUNT] = {};
+        for (size_t i=0; i<count; i++)
+            vacated[parkingSpots[i]->getSpotType()]++;
+        for (int spotType=0; spotType<PARKING_SPOT_TYPE_COUNT; spotType++) {
+            if (vacated[spotType] != 0)
+                update(floorId, (ParkingSpotType)spotType, 0, -vacated[spotType]);
+        }
+    }
+
+    /* Zeroes every count, the journal recounts the slots on recovery */
+    void clear() {
+        for (int i=0; i<PARKING_SPOT_TYPE_COUNT; i++) {
+            lot.spotCounts[i] = 0;
+            lot.occupiedCounts[i] = 0;
+            for (int index=0; index<floorCount; index++) {
+                getFloor(index).spotCounts[i] = 0;
+                getFloor(index).occupiedCounts[i] = 0;
+            }
+        }
+    }
+
+    int getFreeSpots(ParkingSpotType spotType) {
+        return getFreeSpots(lot, spotType);
+    }
+
+    int getFreeSpots(int floorId, ParkingSpotType spotType) {
+        auto index = floorIndexes.find(floorId);
+        return index == floorIndexes.end() ? 0 : getFreeSpots(getFloor(index->second), spotType);
+    }
+
+    /* Counts of every floor. Each count is exact but a snapshot taken while gates run may mix counts from before &
+    after a ticket */
+    vector<FloorOccupancy> getSnapshot() {
+        vector<FloorOccupancy> snapshot(floorCount.load(memory_order_acquire));
+        for (size_t index=0; index<snapshot.size(); index++) {
+            Counters &floor = getFloor(index);
+            snapshot[index].floorId = floor.floorId;
+            for (int i=0; i<PARKING_SPOT_TYPE_COUNT; i++) {
+                snapshot[index].spotCounts[i] = floor.spotCounts[i].load(memory_order_relaxed);
+                snapshot[index].occupiedCounts[i] = floor.occupiedCounts[i].load(memory_order_relaxed);
+            }
+        }
+        return snapshot;
+    }
+
+    /* Number of changes published on the feed so far, 0 until the first subscription. A subscriber polling the board
+    can skip it while this stays the same. */
+    uint64_t getVersion() {
+        return published.load(memory_order_acquire);
+    }
+
+    /* A reader of the feed, starting with the changes published after it subscribed */
+    class Subscription
+    {
+        OccupancyBoard *board;
+        uint64_t cursor;
+
+    public:
+        Subscription(OccupancyBoard *board) {
+            this->board = board;
+            this->cursor = board->published.load();
+        }
+
+        /* Appends the changes published since the last poll. Returns false if the subscriber fell more than
+        FEED_CAPACITY changes behind & missed some, it should then take a snapshot. */
+        bool poll(vector<OccupancyChange> &changes) {
+            bool isComplete = true;
+            uint64_t end = board->getVersion();
+            if (end - cursor > FEED_CAPACITY) {
+                cursor = end - FEED_CAPACITY;
+                isComplete = false;
+            }
+
+            for (; cursor < end; cursor++) {
+                uint64_t entry = board->feedEntries[cursor % FEED_CAPACITY].load(memory_order_acquire);
+                uint16_t lap = entry >> LAP_SHIFT;
+                uint16_t expectedLap = cursor / FEED_CAPACITY + 1;
+                if (lap != expectedLap) {
+                    if ((uint16_t)(lap - expectedLap) >= 0x8000)
+                        break; // claimed but not written yet, picked up by the next poll
+                    isComplete = false; // overwritten by a later lap
+                    continue;
+                }
+
+                int index = (entry >> 2) & ((1 << FLOOR_BITS) - 1);
+                int spotType = entry & 3;
+                Counters &floor = board->getFloor(index);
+                changes.push_back(OccupancyChange{floor.floorId, (ParkingSpotType)spotType, getFreeSpots(floor, spotType)});
+            }
+            return isComplete;
+        }
+    };
+
+    Subscription subscribe() {
+        call_once(feedAllocated, [this]() {
+            feedEntries.reset(new atomic<uint64_t>[FEED_CAPACITY]());
+            feed.store(feedEntries.get(), memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+        });
+        return Subscription(this);
+    }
+};
+
+/* Main entity for this problem statement. A deployment running a single site uses the lot of getInstance(), the panels
+& the journal default to it. An operator of many sites creates a lot per site, see ParkingLotRegistry. A lot owns the
+floors & panels added to it. */
+class ParkingLot
+{
+    int id;
+    string address;
+    vector<ParkingFloor*> parkingFloors;
+    unordered_map<int, ParkingFloor*> floorsById;
+    vector<EntrancePanel*> entryPanels;
+    vector<ExitPanel*> exitPanels;
+    OccupancyBoard occupancyBoard;
+    unique_ptr<ParkingStrategy> defaultStrategy{new NormalParkingStrategy()};
+
+    static ParkingLot* instance;
+
+public:
+    ParkingStrategy *parkingStrategy = defaultStrategy.get();
+    ParkingJournal *journal = NULL;   // no journal, the state is lost with the process
+
+    ParkingLot(int id) {
+        this->id = id;
+    }
+
+    ParkingLot(const ParkingLot&) = delete;
+    ParkingLot& operator=(const ParkingLot&) = delete;
+    ~ParkingLot();
+
+    static ParkingLot* getInstance();
+
+    int getId() {
+        return id;
+    }
+
+    /* Use a ConcurrentParkingStrategy when the entrance & exit panels run on their own threads. The occupancy board is
+    recounted from the slots of the strategy, so set it before the gates start. */
+    void setParkingStrategy(ParkingStrategy *parkingStrategy) {
+        this->parkingStrategy = parkingStrategy;
+        vector<ParkingSpot*> parkingSpots;
+        parkingStrategy->getParkingSpots(parkingSpots);
+        occupancyBoard.clear();
+        for (ParkingSpot *parkingSpot: parkingSpots) {
+            occupancyBoard.addParkingSpots(parkingSpot->getFloorId(), parkingSpot->getSpotType(), 1);
+            if (!parkingSpot->getAvailability())
+                occupancyBoard.markParkingSpot(parkingSpot);
+        }
+    }
+
+    void setAddress(string address) {
+        this->address = address;
+    }
+
+    /* Every allotted & vacated slot is logged to the journal before the gate goes on */
+    void setJournal(ParkingJournal *journal) {
+        this->journal = journal;
+    }
+
+    int addParkingFloor(ParkingFloor *floor) {
+        parkingFloors.push_back(floor);
+        floorsById[floor->getFloorId()] = floor;
+        occupancyBoard.addParkingFloor(floor->getFloorId());
+        return 0;
+    }
+
+    ParkingFloor* getParkingFloor(int floorId) {
+        auto floor = floorsById.find(floorId);
+        return floor == floorsById.end() ? NULL : floor->second;
+    }
+
+    vector<ParkingFloor*>& getParkingFloors() {
+        return parkingFloors;
+    }
+
+    /* Counts of the slots per floor & spot type, read it instead of asking the parking strategy */
+    OccupancyBoard& getOccupancyBoard() {
+        return occupancyBoard;
+    }
+
+    /* Marks an allotted slot on its floor & on the occupancy board */
+    void markParkingSpot(ParkingSpot *parkingSpot) {
+        ParkingFloor *floor = getParkingFloor(parkingSpot->getFloorId());
+        if (floor != NULL)
+            floor->markParkingSpot(parkingSpot);
+        occupancyBoard.markParkingSpot(parkingSpot);
+    }
+
+    void vacateParkingSpot(ParkingSpot *parkingSpot) {
+        ParkingFloor *floor = getParkingFloor(parkingSpot->getFloorId());
+        if (floor != NULL)
+            floor->vacateParkingSpot(parkingSpot->getSpotId());
+        occupancyBoard.vacateParkingSpot(parkingSpot);
+    }
+
+    /* Vacates a batch of slots sorted by floor (the order of parkingSpots changes), so every floor is looked up,
+    locked & updated on the occupancy board once */
+    void vacateParkingSpots(ParkingSpot **parkingSpots, size_t count) {
+        sort(parkingSpots, parkingSpots + count, [](ParkingSpot *a, ParkingSpot *b) {
+            return a->getFloorId() < b->getFloorId();
+        });
+        for (size_t first=0, last; first<count; first=last) {
+            int floorId = parkingSpots[first]->getFloorId();
+            for (last=first+1; last<count && parkingSpots[last]->getFloorId() == floorId; last++);
+
+            ParkingFloor *floor = getParkingFloor(floorId);
+            if (floor != NULL)
+                floor->vacateParkingSpots(parkingSpots + first, last - first);
+            occupancyBoard.vacateParkingSpots(floorId, parkingSpots + first, last - first);
+        }
+    }
+
+    /* Adds the slots through the parking strategy & logs them to the journal with a single sync. Slots added straight to
+    the strategy are not on the occupancy board. */
+    vector<ParkingSpot*> addParkingSpots(int floorId, ParkingSpotType spotType, const vector<Position> &positions);
+
+    vector<ParkingSpot*> addParkingSpots(int floorId, ParkingSpotType spotType, int count = 1) {
+        return addParkingSpots(floorId, spotType, vector<Position>(count, Position()));
+    }
+
+    int addEntryPanel(EntrancePanel *entryPanel) {
+        entryPanels.push_back(entryPanel);
+        return 0;
+    } 
+
+    int addExitPanel(ExitPanel *exitPanel) {
+        exitPanels.push_back(exitPanel);
+        return 0;
+    }
+
+    vector<EntrancePanel*>& getEntryPanels() {
+        return entryPanels;
+    }
+
+    vector<ExitPanel*>& getExitPanels() {
+        return exitPanels;
+    }
+
+    /* A snapshot only, getting a ticket checks & claims a slot at once */
+    bool canPark(VehicleType vehicleType) {
+        return occupancyBoard.getFreeSpots(getSpotTypeFromVehicleType(vehicleType)) > 0;
+    }
+};
+
+ParkingLot* ParkingLot::instance = NULL;
+
+ParkingLot* ParkingLot::getInstance()
+{
+    static once_flag created;
+    call_once(created, []() { instance = new ParkingLot(1); });
+
+    return instance;
+}
+
+/* =========================================================== */
+/* ====================== Reservations ======================= */
+/* =========================================================== */
+
+/* Hierarchical timing wheel: LEVELS wheels of 256 slots, a timer sits on the lowest level whose slot covers its deadline
+given the current tick (level l slots span 256^l ticks). Timers live in a flat array & are doubly linked per slot, so
+scheduling & cancelling are O(1). A tick fires the timers of its level 0 slot, and once every 256^l ticks the next slot of
+level l is spread over the lower levels, so a timer moves at most LEVELS - 1 times before firing. Deadlines are in ticks,
+below 2^32. Not thread safe. */
+class TimingWheel
+{
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const uint32_t SLOTS = 1 << SLOT_BITS;
+    static constexpr uint32_t NIL = 0xFFFFFFFF;
+    static const uint16_t UNSCHEDULED = 0xFFFF;
+
+    struct Timer {
+        uint64_t deadline;
+        uint64_t payload;
+        uint32_t next;
+        uint32_t prev;         // NIL for the first timer of a slot
+        uint32_t generation;   // bumped every time the timer is freed, part of the timer's id
+        uint16_t slot;         // level * SLOTS + slot of the level, UNSCHEDULED when free
+    };
+
+    vector<Timer> timers;
+    uint32_t freeTimers = NIL;   // linked through next
+    uint32_t heads[LEVELS * SLOTS];
+    uint64_t now = 0;
+    size_t count = 0;
+
+    void link(uint32_t index) {
+        Timer &timer = timers[index];
+        uint64_t differentBits = timer.deadline ^ now;
+        int level = 0;
+        while (level < LEVELS - 1 && differentBits >= 1ULL << (SLOT_BITS * (level + 1)))
+            level++;
+        uint32_t slot = level * SLOTS + ((timer.deadline >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+        timer.slot = slot;
+        timer.prev = NIL;
+        timer.next = heads[slot];
+        if (heads[slot] != NIL)
+            timers[heads[slot]].prev = index;
+        heads[slot] = index;
+    }
+
+    void unlink(uint32_t index) {
+        Timer &timer = timers[index];
+        if (timer.prev == NIL)
+            heads[timer.slot] = timer.next;
+        else
+            timers[timer.prev].next = timer.next;
+        if (timer.next != NIL)
+            timers[timer.next].prev = timer.prev;
+    }
+
+    void freeTimer(uint32_t index) {
+        Timer &timer = timers[index];
+        timer.slot = UNSCHEDULED;
+        timer.generation = (timer.generation + 1) & 0x7FFFFFFF;
+        timer.next = freeTimers;
+        freeTimers = index;
+        count--;
+    }
+
+    /* Index of the timer with the id if it is still scheduled, NIL otherwise */
+    uint32_t find(uint64_t timerId) {
+        uint32_t index = (uint32_t)timerId;
+        if (index >= timers.size() || timers[index].slot == UNSCHEDULED || timers[index].generation != timerId >> 32)
+            return NIL;
+        return index;
+    }
+
+    /* Spreads the timers of a slot of an upper level over the lower levels */
+    void cascade(uint32_t slot) {
+        uint32_t index = heads[slot];
+        heads[slot] = NIL;
+        while (index != NIL) {
+            uint32_t next = timers[index].next;
+            link(index);
+            index = next;
+        }
+    }
+
+public:
+    static const uint64_t MAX_DEADLINE = (1ULL << (SLOT_BITS * LEVELS)) - 1;
+
+    TimingWheel() {
+        fill(begin(heads), end(heads), NIL);
+    }
+
+    uint64_t getNow() {
+        return now;
+    }
+
+    size_t getCount() {
+        return count;
+    }
+
+    /* Returns the id of the timer, firing at the deadline or on the next tick if the deadline is past */
+    uint64_t schedule(uint64_t deadline, uint64_t payload) {
+        if (deadline > MAX_DEADLINE)
+            throw invalid_argument("timer deadlines must be below 2^32 ticks");
+        uint32_t index = freeTimers;
+        if (index == NIL) {
+            index = timers.size();
+            timers.push_back(Timer{0, 0, NIL, NIL, 1, UNSCHEDULED});
+        } else {
+            freeTimers = timers[index].next;
+        }
+
+        Timer &timer = timers[index];
+        timer.deadline = max(deadline, now + 1);
+        timer.payload = payload;
+        link(index);
+        count++;
+        return (uint64_t)timer.generation << 32 | index;
+    }
+
+    bool getPayload(uint64_t timerId, uint64_t &payload) {
+        uint32_t index = find(timerId);
+        if (index == NIL)
+            return false;
+        payload = timers[index].payload;
+        return true;
+    }
+
+    /* False if the timer already fired or was cancelled */
+    bool cancel(uint64_t timerId, uint64_t &payload) {
+        uint32_t index = find(timerId);
+        if (index == NIL)
+            return false;
+        payload = timers[index].payload;
+        unlink(index);
+        freeTimer(index);
+        return true;
+    }
+
+    /* Moves the clock to the tick, calling onFire(payload) for every timer due on the way. Returns the number fired. */
+    template <typename OnFire>
+    size_t advance(uint64_t tick, OnFire &&onFire) {
+        size_t fired = 0;
+        if (count == 0 && tick > now)
+            now = tick; // nothing to cascade or fire on the way
+        while (now < tick) {
+            now++;
+            int level = 0;
+            while (level < LEVELS - 1 && (now & ((1ULL << (SLOT_BITS * (level + 1))) - 1)) == 0)
+                level++;
+            for (; level > 0; level--)
+                cascade(level * SLOTS + ((now >> (SLOT_BITS * level)) & (SLOTS - 1)));
+
+            uint32_t slot = now & (SLOTS - 1);
+            while (heads[slot] != NIL) {
+                uint32_t index = heads[slot];
+                uint64_t payload = timers[index].payload;
+                unlink(index);
+                freeTimer(index);
+                fired++;
+                onFire(payload);
+            }
+        }
+        return fired;
+    }
+
+    /* Cancels every timer, calling onCancel(payload) for each */
+    template <typename OnCancel>
+    void cancelAll(OnCancel &&onCancel) {
+        for (uint32_t index=0; index<timers.size(); index++) {
+            if (timers[index].slot != UNSCHEDULED) {
+                uint64_t payload = timers[index].payload;
+                unlink(index);
+                freeTimer(index);
+                onCancel(payload);
+            }
+        }
+    }
+};
+
+/* Holds on slots for customers who booked ahead. A hold takes its slot out of the parking strategy like an allotment &
+marks it occupied on the lot, so getParkingSpot never comes across a held slot and costs the same with or without holds.
+The customer's vehicle claims the hold at an entrance panel. A hold not claimed by its deadline is given back by
+expireHolds, to be called about once a second. Deadlines are on a TimingWheel of 1 second ticks, so with 1M holds
+outstanding a hold, a cancel & a tick are still O(1). Holds are not journaled, a restart drops them. */
+class ReservationBook
+{
+    ParkingLot *parkingLot;
+    TimingWheel holds;   // payload: the held ParkingSpot
+    time_t origin;       // time of tick 0
+    mutex bookMutex;
+
+    uint64_t getTick(time_t now) {
+        return now > origin ? now - origin : 0;
+    }
+
+    void release(ParkingSpot *parkingSpot) {
+        parkingLot->vacateParkingSpot(parkingSpot);
+        parkingLot->parkingStrategy->vacateParkingSpot(parkingSpot);
+    }
+
+public:
+    ReservationBook(ParkingLot *parkingLot = ParkingLot::getInstance(), time_t now = time(NULL)) {
+        this->parkingLot = parkingLot;
+        this->origin = now;
+    }
+
+    /* Gives back the slots still held */
+    ~ReservationBook() {
+        holds.cancelAll([this](uint64_t payload) { release((ParkingSpot*)payload); });
+    }
+
+    /* Holds a slot of the spot type for holdSeconds from now. Returns the reservation id, -1 if no slot is free. */
+    int64_t reserve(ParkingSpotType spotType, int holdSeconds, time_t now = time(NULL)) {
+        lock_guard<mutex> lock(bookMutex);
+        ParkingSpot *parkingSpot = parkingLot->parkingStrategy->getParkingSpot(spotType);
+        if (parkingSpot == NULL)
+            return -1;
+        parkingLot->markParkingSpot(parkingSpot);
+        return holds.schedule(getTick(now) + max(holdSeconds, 0), (uint64_t)parkingSpot);
+    }
+
+    /* Gives the slot back before the deadline. False if the hold is unknown, claimed or expired. */
+    bool cancel(int64_t reservationId) {
+        lock_guard<mutex> lock(bookMutex);
+        uint64_t payload;
+        if (!holds.cancel(reservationId, payload))
+            return false;
+        release((ParkingSpot*)payload);
+        return true;
+    }
+
+    /* Ends the hold & hands over its slot, still marked occupied, to the vehicle. NULL if the hold is unknown, claimed
+    or expired, or is for another spot type (the hold is then kept). */
+    ParkingSpot* claim(int64_t reservationId, ParkingSpotType spotType) {
+        lock_guard<mutex> lock(bookMutex);
+        uint64_t payload;
+        if (!holds.getPayload(reservationId, payload) || ((ParkingSpot*)payload)->getSpotType() != spotType)
+            return NULL;
+        holds.cancel(reservationId, payload);
+        return (ParkingSpot*)payload;
+    }
+
+    /* Gives back the slots of the holds past their deadline. Returns how many. */
+    size_t expireHolds(time_t now = time(NULL)) {
+        lock_guard<mutex> lock(bookMutex);
+        return holds.advance(getTick(now), [this](uint64_t payload) { release((ParkingSpot*)payload); });
+    }
+
+    size_t getHoldCount() {
+        lock_guard<mutex> lock(bookMutex);
+        return holds.getCount();
+    }
+};
+
+/* =========================================================== */
+/* ======================= Persistence ======================= */
+/* =========================================================== */
+
+enum JournalRecordType: uint8_t { ADD_SPOT = 1, PARK, VACATE };
+
+/* Fixed size record of the write ahead log, a record torn by a crash is caught by its size or its checksum.
+Plates longer than 16 characters are cut to their first 16 characters. */
+struct JournalRecord
+{
+    uint8_t type;
+    uint8_t spotType;
+    uint8_t vehicleType;
+    uint8_t plateLength;
+    int32_t floorId;
+    uint32_t spotId;
+    uint32_t checksum;   // FNV-1a of the record with the checksum set to 0
+    int64_t ticketNumber;
+    int64_t issuedAt;
+    union {
+        char plate[16];
+        Position position;   // of the slot, in ADD_SPOT records
+    };
+};
+
+static_assert(sizeof(JournalRecord) == 48, "journal records are 48 bytes on disk");
+
+/* Spot entry of a snapshot */
+struct JournalSpot
+{
+    int32_t floorId;
+    uint8_t spotType;
+    uint8_t exists;
+    uint16_t unused;
+    Position position;
+};
+
+/* Snapshot file: header, spots by spot id, bitmap of the occupied spots, PARK records of the open tickets, checksum */
+struct JournalSnapshotHeader
+{
+    char magic[8];
+    uint32_t nextSegment;   // first log segment not covered by the snapshot
+    uint32_t spotCount;
+    uint64_t ticketCount;
+};
+
+uint32_t getJournalChecksum(const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+/* Write ahead log of the slots added, allotted & vacated, with periodic snapshots, so that a restarted lot gets back
+every open ticket & the occupancy of every slot.
+Group commit: a gate appends its record to the pending batch & waits; a committer thread writes out whatever is pending
+with one write & one fdatasync and wakes up every gate whose record is now on disk, so under load one sync covers many
+records. The journal also keeps a compact image of the durable state (the slots, a bitmap of the occupied ones & the open
+tickets), a snapshot writes that image out & starts a new log segment, then the older segments are deleted. Recovery
+loads the latest snapshot, replays the segments after it up to the first torn record and rebuilds the strategy & the
+floors from the result.
+Files: <basePath>.snapshot and the log segments <basePath>.000001.wal, <basePath>.000002.wal, ... */
+class ParkingJournal
+{
+    string basePath;
+    chrono::milliseconds snapshotInterval;
+    int fd = -1;
+    uint32_t firstSegment = 1;   // oldest segment on disk
+    uint32_t segment = 0;        // segment being appended to
+
+    // image of the logged state, the spot ids are the ones of the running strategy
+    vector<JournalSpot> spots;
+    vector<uint64_t> occupied;
+    unordered_map<int64_t, JournalRecord> openTickets;
+
+    mutex writeMutex;    // held while a batch or a snapshot is written, taken before bufferMutex
+    mutex bufferMutex;   // guards everything below & the image
+    condition_variable pendingChanged, durableChanged;
+    vector<JournalRecord> pending;
+    uint64_t appendedLsn = 0, durableLsn = 0;
+    string failure;      // set once a write failed, nothing gets durable anymore
+    bool isStopping = false;
+    thread committer, snapshotter;
+
+    atomic<uint64_t> syncs{0}, syncedRecords{0};
+
+    string getSegmentPath(uint32_t number) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%06u.wal", number);
+        return basePath + suffix;
+    }
+
+    string getSnapshotPath() {
+        return basePath + ".snapshot";
+    }
+
+    static void writeFully(int fd, const void *data, size_t size) {
+        const char *bytes = (const char*)data;
+        while (size > 0) {
+            ssize_t written = write(fd, bytes, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+                throw runtime_error(string("journal write failed: ") + strerror(errno));
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    static bool readFile(const string &path, vector<char> &contents) {
+        ifstream file(path, ios::binary);
+        if (!file)
+            return false;
+        contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        return true;
+    }
+
+    void openSegment(uint32_t number) {
+        if (fd >= 0)
+            close(fd);
+        segment = number;
+        fd = open(getSegmentPath(number).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw runtime_error("can't open journal segment " + getSegmentPath(number) + ": " + strerror(errno));
+    }
+
+    void writeBatch(vector<JournalRecord> &batch) {
+        writeFully(fd, batch.data(), batch.size() * sizeof(JournalRecord));
+        if (fdatasync(fd) != 0)
+            throw runtime_error(string("journal sync failed: ") + strerror(errno));
+        syncs++;
+        syncedRecords += batch.size();
+    }
+
+    /* Applies a record to the image of the logged state */
+    void apply(const JournalRecord &record) {
+        if (record.spotId >= spots.size()) {
+            spots.resize(record.spotId + 1, JournalSpot{0, 0, 0, 0, Position()});
+            occupied.resize(spots.size() / 64 + 1, 0);
+        }
+
+        switch (record.type) {
+            case ADD_SPOT:
+                spots[record.spotId] = JournalSpot{record.floorId, record.spotType, 1, 0, record.position};
+                break;
+            case PARK:
+                occupied[record.spotId / 64] |= 1ULL << (record.spotId % 64);
+                openTickets[record.ticketNumber] = record;
+                break;
+            case VACATE:
+                occupied[record.spotId / 64] &= ~(1ULL << (record.spotId % 64));
+                openTickets.erase(record.ticketNumber);
+                break;
+        }
+    }
+
+    /* Appends the records & returns once they are on disk */
+    void append(JournalRecord *records, size_t count) {
+        for (size_t i=0; i<count; i++) {
+            records[i].checksum = 0;
+            records[i].checksum = getJournalChecksum(&records[i], sizeof(JournalRecord));
+        }
+
+        unique_lock<mutex> lock(bufferMutex);
+        if (!failure.empty())
+            throw runtime_error(failure);
+        for (size_t i=0; i<count; i++) {
+            apply(records[i]);
+            pending.push_back(records[i]);
+        }
+        uint64_t lsn = appendedLsn += count;
+        pendingChanged.notify_one();
+
+        durableChanged.wait(lock, [&]() { return durableLsn >= lsn || !failure.empty(); });
+        if (durableLsn < lsn)
+            throw runtime_error(failure);
+    }
+
+    void commitBatches() {
+        vector<JournalRecord> batch;
+        while (true) {
+            {
+                unique_lock<mutex> lock(bufferMutex);
+                pendingChanged.wait(lock, [&]() { return !pending.empty() || isStopping; });
+                if (pending.empty())
+                    return;
+            }
+
+            lock_guard<mutex> writeLock(writeMutex);
+            uint64_t lsn;
+            {
+                lock_guard<mutex> lock(bufferMutex);
+                batch.swap(pending);
+                lsn = appendedLsn;
+            }
+
+            string error;
+            try {
+                if (!batch.empty())
+                    writeBatch(batch);
+            } catch (const exception &e) {
+                error = e.what();
+            }
+            batch.clear();
+
+            lock_guard<mutex> lock(bufferMutex);
+            if (error.empty())
+                durableLsn = max(durableLsn, lsn);
+            else
+                failure = error;
+            durableChanged.notify_all();
+            if (!error.empty())
+                return;
+        }
+    }
+
+    void takeSnapshots() {
+        unique_lock<mutex> lock(bufferMutex);
+        while (!isStopping) {
+            if (durableChanged.wait_for(lock, snapshotInterval, [&]() { return isStopping; }))
+                break;
+            lock.unlock();
+            try {
+                snapshot();
+            } catch (const exception &e) {
+                cerr << "parking journal snapshot failed: " << e.what() << endl;
+            }
+            lock.lock();
+        }
+    }
+
+    /* Writes the image as a snapshot & deletes the segments it covers, called with writeMutex held */
+    void writeSnapshot(vector<char> &image, uint32_t nextSegment) {
+        string tmpPath = getSnapshotPath() + ".tmp";
+        int snapshotFd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (snapshotFd < 0)
+            throw runtime_error("can't open journal snapshot " + tmpPath + ": " + strerror(errno));
+        try {
+            writeFully(snapshotFd, image.data(), image.size());
+            if (fsync(snapshotFd) != 0)
+                throw runtime_error(string("journal snapshot sync failed: ") + strerror(errno));
+        } catch (...) {
+            close(snapshotFd);
+            throw;
+        }
+        close(snapshotFd);
+        if (rename(tmpPath.c_str(), getSnapshotPath().c_str()) != 0)
+            throw runtime_error(string("can't replace journal snapshot: ") + strerror(errno));
+
+        for (; firstSegment < nextSegment; firstSegment++)
+            unlink(getSegmentPath(firstSegment).c_str());
+    }
+
+    /* Serializes the image, called with bufferMutex held */
+    vector<char> getImage(uint32_t nextSegment) {
+        JournalSnapshotHeader header;
+        memcpy(header.magic, "PSNAP002", sizeof(header.magic));
+        header.nextSegment = nextSegment;
+        header.spotCount = spots.size();
+        header.ticketCount = openTickets.size();
+
+        vector<char> image(sizeof(header) + spots.size() * sizeof(JournalSpot) + occupied.size() * sizeof(uint64_t)
+            + openTickets.size() * sizeof(JournalRecord) + sizeof(uint32_t));
+        char *position = image.data();
+        auto put = [&position](const void *data, size_t size) {
+            memcpy(position, data, size);
+            position += size;
+        };
+        put(&header, sizeof(header));
+        put(spots.data(), spots.size() * sizeof(JournalSpot));
+        put(occupied.data(), occupied.size() * sizeof(uint64_t));
+        for (auto &ticket: openTickets)
+            put(&ticket.second, sizeof(JournalRecord));
+        uint32_t checksum = getJournalChecksum(image.data(), position - image.data());
+        put(&checksum, sizeof(checksum));
+        return image;
+    }
+
+    /* Loads the image from the snapshot, returns the first segment to replay */
+    uint32_t loadSnapshot() {
+        vector<char> image;
+        if (!readFile(getSnapshotPath(), image))
+            return 1;
+
+        JournalSnapshotHeader header;
+        if (image.size() < sizeof(header) + sizeof(uint32_t))
+            throw runtime_error("journal snapshot " + getSnapshotPath() + " is truncated");
+        memcpy(&header, image.data(), sizeof(header));
+        size_t bitmapWords = header.spotCount == 0 ? 0 : header.spotCount / 64 + 1;
+        size_t size = sizeof(header) + header.spotCount * sizeof(JournalSpot) + bitmapWords * sizeof(uint64_t)
+            + header.ticketCount * sizeof(JournalRecord);
+        uint32_t checksum;
+        if (memcmp(header.magic, "PSNAP002", sizeof(header.magic)) != 0 || image.size() != size + sizeof(checksum))
+            throw runtime_error("journal snapshot " + getSnapshotPath() + " is corrupt");
+        memcpy(&checksum, image.data() + size, sizeof(checksum));
+        if (checksum != getJournalChecksum(image.data(), size))
+            throw runtime_error("journal snapshot " + getSnapshotPath() + " is corrupt");
+
+        const char *position = image.data() + sizeof(header);
+        spots.resize(header.spotCount);
+        memcpy(spots.data(), position, spots.size() * sizeof(JournalSpot));
+        position += spots.size() * sizeof(JournalSpot);
+        occupied.resize(bitmapWords);
+        memcpy(occupied.data(), position, occupied.size() * sizeof(uint64_t));
+        position += occupied.size() * sizeof(uint64_t);
+        openTickets.reserve(header.ticketCount);
+        for (uint64_t i=0; i<header.ticketCount; i++, position += sizeof(JournalRecord)) {
+            JournalRecord record;
+            memcpy(&record, position, sizeof(record));
+            openTickets[record.ticketNumber] = record;
+        }
+
+        firstSegment = header.nextSegment;
+        return header.nextSegment;
+    }
+
+    /* Replays a segment into the image up to its first torn record, returns false if there is no such segment */
+    bool replaySegment(uint32_t number) {
+        vector<char> contents;
+        if (!readFile(getSegmentPath(number), contents))
+            return false;
+
+        for (size_t offset=0; offset + sizeof(JournalRecord) <= contents.size(); offset += sizeof(JournalRecord)) {
+            JournalRecord record;
+            memcpy(&record, contents.data() + offset, sizeof(record));
+            uint32_t checksum = record.checksum;
+            record.checksum = 0;
+            if (checksum != getJournalChecksum(&record, sizeof(record)))
+                break; // torn by a crash, nothing after it was acknowledged
+            apply(record);
+        }
+        return true;
+    }
+
+public:
+    ParkingJournal(string basePath, chrono::milliseconds snapshotInterval = chrono::minutes(1)) {
+        this->basePath = basePath;
+        this->snapshotInterval = snapshotInterval;
+    }
+
+    ~ParkingJournal() {
+        {
+            lock_guard<mutex> lock(bufferMutex);
+            isStopping = true;
+        }
+        pendingChanged.notify_all();
+        durableChanged.notify_all();
+        if (committer.joinable())
+            committer.join();
+        if (snapshotter.joinable())
+            snapshotter.join();
+        if (fd >= 0)
+            close(fd);
+    }
+
+    /* Rebuilds the slots into the (empty) strategy, marks the occupied ones on their floors & returns the open tickets
+    with their vehicles, all taken from the pools. Slots get new ids, so the journal checkpoints the rebuilt state right
+    away. Must be called once before anything is logged, also when starting from scratch. */
+    vector<ParkingTicket*> recover(ParkingStrategy &strategy, ParkingLot *parkingLot = ParkingLot::getInstance()) {
+        uint32_t number = loadSnapshot();
+        while (replaySegment(number))
+            number++;
+
+        for (ParkingFloor *floor: parkingLot->getParkingFloors())
+            floor->vacateAllParkingSpots();
+        parkingLot->getOccupancyBoard().clear();
+
+        vector<ParkingSpot*> restoredSpots(spots.size(), NULL);
+        for (size_t spotId=0; spotId<spots.size(); spotId++) {
+            if (spots[spotId].exists) {
+                bool isAvailable = (occupied[spotId / 64] >> (spotId % 64) & 1) == 0;
+                restoredSpots[spotId] = strategy.restoreParkingSpot(spots[spotId].floorId, (ParkingSpotType)spots[spotId].spotType, spots[spotId].position, isAvailable);
+                parkingLot->getOccupancyBoard().addParkingSpots(spots[spotId].floorId, (ParkingSpotType)spots[spotId].spotType, 1);
+            }
+        }
+
+        vector<ParkingTicket*> parkingTickets;
+        parkingTickets.reserve(openTickets.size());
+        for (auto &ticket: openTickets) {
+            JournalRecord &record = ticket.second;
+            ParkingSpot *parkingSpot = record.spotId < restoredSpots.size() ? restoredSpots[record.spotId] : NULL;
+            if (parkingSpot == NULL)
+                continue; // a slot that was never added, can't happen unless the journal was tampered with
+
+            ParkingTicket *parkingTicket = ObjectPool<ParkingTicket>::getInstance().create();
+            parkingTicket->setTicketNumber(record.ticketNumber);
+            parkingTicket->setIssuedAt(record.issuedAt);
+            parkingTicket->setAllocatedSpot(parkingSpot);
+            parkingTicket->setVehicle(VehicleFactory::createVehicle(string(record.plate, record.plateLength), (VehicleType)record.vehicleType));
+            parkingTickets.push_back(parkingTicket);
+            parkingLot->markParkingSpot(parkingSpot);
+        }
+
+        // image in terms of the new slot ids
+        spots.clear();
+        occupied.clear();
+        openTickets.clear();
+        for (ParkingSpot *parkingSpot: restoredSpots) {
+            if (parkingSpot != NULL)
+                apply(getSpotRecord(parkingSpot));
+        }
+        for (ParkingTicket *parkingTicket: parkingTickets)
+            apply(getTicketRecord(PARK, parkingTicket));
+
+        lock_guard<mutex> writeLock(writeMutex);
+        openSegment(max(number, firstSegment));
+        vector<char> image = getImage(segment);
+        writeSnapshot(image, segment);
+
+        committer = thread(&ParkingJournal::commitBatches, this);
+        snapshotter = thread(&ParkingJournal::takeSnapshots, this);
+        return parkingTickets;
+    }
+
+    /* Writes the image of the state logged so far as the new snapshot & drops the log segments it covers. Appends go on
+    meanwhile, only the copy of the image holds them up. */
+    void snapshot() {
+        lock_guard<mutex> writeLock(writeMutex);
+        vector<char> image;
+        {
+            lock_guard<mutex> lock(bufferMutex);
+            if (!failure.empty())
+                throw runtime_error(failure);
+
+            // the records pending now belong to the current segment, which the snapshot covers
+            if (!pending.empty()) {
+                try {
+                    writeBatch(pending);
+                } catch (const exception &e) {
+                    failure = e.what();
+                    durableChanged.notify_all();
+                    throw;
+                }
+                pending.clear();
+                durableLsn = appendedLsn;
+                durableChanged.notify_all();
+            }
+            openSegment(segment + 1);
+            image = getImage(segment);
+        }
+        writeSnapshot(image, segment);
+    }
+
+    static JournalRecord getSpotRecord(ParkingSpot *parkingSpot) {
+        JournalRecord record = {};
+        record.type = ADD_SPOT;
+        record.spotType = parkingSpot->getSpotType();
+        record.floorId = parkingSpot->getFloorId();
+        record.spotId = parkingSpot->getSpotId();
+        record.position = parkingSpot->getPosition();
+        return record;
+    }
+
+    static JournalRecord getTicketRecord(JournalRecordType type, ParkingTicket *parkingTicket) {
+        JournalRecord record = getSpotRecord(parkingTicket->getAllocatedSpot());
+        record.type = type;
+        memset(record.plate, 0, sizeof(record.plate));
+        record.ticketNumber = parkingTicket->getTicketNumber();
+        record.issuedAt = parkingTicket->getIssuedAt();
+        Vehicle *vehicle = parkingTicket->getVehicle();
+        string plate = vehicle->getLicensePlateNumber();
+        record.vehicleType = vehicle->getType();
+        record.plateLength = min(plate.size(), sizeof(record.plate));
+        memcpy(record.plate, plate.data(), record.plateLength);
+        return record;
+    }
+
+    void logAddSpots(vector<ParkingSpot*> &parkingSpots) {
+        vector<JournalRecord> records;
+        for (ParkingSpot *parkingSpot: parkingSpots)
+            records.push_back(getSpotRecord(parkingSpot));
+        append(records.data(), records.size());
+    }
+
+    void logPark(ParkingTicket *parkingTicket) {
+        JournalRecord record = getTicketRecord(PARK, parkingTicket);
+        append(&record, 1);
+    }
+
+    void logVacate(ParkingTicket *parkingTicket) {
+        JournalRecord record = getTicketRecord(VACATE, parkingTicket);
+        append(&record, 1);
+    }
+
+    void logVacates(ParkingTicket *const *parkingTickets, size_t count) {
+        vector<JournalRecord> records;
+        for (size_t i=0; i<count; i++)
+            records.push_back(getTicketRecord(VACATE, parkingTickets[i]));
+        append(records.data(), records.size());
+    }
+
+    size_t getOpenTicketCount() {
+        lock_guard<mutex> lock(bufferMutex);
+        return openTickets.size();
+    }
+
+    /* Number of fdatasyncs & of the records they covered so far, how well the group commit batches */
+    uint64_t getSyncCount() {
+        return syncs;
+    }
+
+    uint64_t getSyncedRecordCount() {
+        return syncedRecords;
+    }
+};
+
+/* With a journal the slots are added occupied & only freed once their ADD_SPOT records are on disk, a gate allotting one
+earlier could get its PARK record synced first and a crash in between would lose the ticket on recovery */
+vector<ParkingSpot*> ParkingLot::addParkingSpots(int floorId, ParkingSpotType spotType, const vector<Position> &positions)
+{
+    vector<ParkingSpot*> parkingSpots;
+    for (Position position: positions)
+        parkingSpots.push_back(parkingStrategy->restoreParkingSpot(floorId, spotType, position, journal == NULL));
+    if (journal != NULL)
+        journal->logAddSpots(parkingSpots);
+    occupancyBoard.addParkingSpots(floorId, spotType, positions.size());
+    if (journal != NULL)
+        parkingStrategy->vacateParkingSpots(parkingSpots.data(), parkingSpots.size());
+    parkingStrategy->updateGates();
+    return parkingSpots;
+}
+
+/* Entrance Panel is where user gets the parking ticket and spot gets allocated */
+class EntrancePanel
+{
+    ParkingLot *parkingLot;
+    int id;
+    int floorId;
+    Position position;   // strategies allotting the slots nearest to the gate measure from here
+
+    /* Builder design pattern used when constructing Parking Ticket, tickets come from a pool and go back on exit.
+    The ticket is logged to the journal, on failure it is recycled & the error thrown. */
+    ParkingTicket* issueParkingTicket(Vehicle *vehicle, ParkingSpot *parkingSpot) {
+        ParkingTicket *parkingTicket = ObjectPool<ParkingTicket>::getInstance().create();
+        parkingTicket->setIssuedAt(time(NULL));
+        parkingTicket->setAllocatedSpot(parkingSpot);
+        parkingTicket->setVehicle(vehicle);
+        parkingTicket->setTicketNumber(IdGenerator::getInstance().nextId());
+
+        if (parkingLot->journal != NULL) {
+            try {
+                parkingLot->journal->logPark(parkingTicket);
+            } catch (...) {
+                ObjectPool<ParkingTicket>::getInstance().release(parkingTicket);
+                throw;
+            }
+        }
+        return parkingTicket;
+    }
+
+public:
+    EntrancePanel(ParkingLot *parkingLot, int id, int floorId = 0, Position position = Position()) {
+        this->parkingLot = parkingLot;
+        this->id = id;
+        this->floorId = floorId;
+        this->position = position;
+        parkingLot->parkingStrategy->addGate(floorId, position);
+    }
+
+    EntrancePanel(int id, int floorId = 0, Position position = Position()):
+        EntrancePanel(ParkingLot::getInstance(), id, floorId, position) {}
+
+    ParkingTicket* getParkingTicket(Vehicle *vehicle) {
+        /* No separate canPark check, getting the spot checks & claims it in one step so two gates can't race for the last spot */
+        ParkingSpotType spotType = getSpotTypeFromVehicleType(vehicle->getType());
+        ParkingSpot* parkingSpot = parkingLot->parkingStrategy->getParkingSpot(spotType, floorId, position);
+        if (parkingSpot == NULL) return NULL;
+
+        ParkingTicket *parkingTicket;
+        try {
+            parkingTicket = issueParkingTicket(vehicle, parkingSpot);
+        } catch (...) {
+            parkingLot->parkingStrategy->vacateParkingSpot(parkingSpot);
+            throw;
+        }
+        parkingLot->markParkingSpot(parkingSpot);
+        return parkingTicket;
+    }
+
+    /* Ticket for the slot held by a reservation. NULL if the hold expired, was cancelled or is for another spot type. */
+    ParkingTicket* getParkingTicket(Vehicle *vehicle, ReservationBook &reservations, int64_t reservationId) {
+        ParkingSpot *parkingSpot = reservations.claim(reservationId, getSpotTypeFromVehicleType(vehicle->getType()));
+        if (parkingSpot == NULL) return NULL;
+
+        try {
+            return issueParkingTicket(vehicle, parkingSpot);
+        } catch (...) {
+            parkingLot->vacateParkingSpot(parkingSpot);
+            parkingLot->parkingStrategy->vacateParkingSpot(parkingSpot);
+            throw;
+        }
+    }
+};
+
+/* Exit Panel scans the parking ticket, vacate the spot and calculates the parking charges */
+class ExitPanel
+{
+    ParkingLot *parkingLot;
+    int id;
+    int hourlyCosts[PARKING_SPOT_TYPE_COUNT];   // by spot type
+
+    // batch being settled, one entry per ticket, kept to not allocate on every batch
+    vector<int> issuedAts;
+    vector<int> spotTypes;
+    vector<int> charges;
+    vector<ParkingSpot*> parkingSpots;
+
+    int calculateCost(ParkingTicket *parkingTicket) {
+        int duration = time(NULL) - parkingTicket->getIssuedAt();
+        
+        int hours = duration / (60 * 60);
+        if (hours == 0) hours = 1;
+        
+        return hours * hourlyCosts[parkingTicket->getAllocatedSpot()->getSpotType()];
+    }
+
+    /* Charges of a batch at time now. A plain loop over flat arrays which the compiler vectorizes (GCC does at -O3), the
+    hourly cost is picked with selects as a lookup in the table would need a gather */
+    static void calculateCosts(int now, const int *__restrict issuedAt, const int *__restrict spotType, const int *hourlyCosts,
+        int *__restrict charge, size_t count) {
+        int small = hourlyCosts[ParkingSpotType::SMALL], medium = hourlyCosts[ParkingSpotType::MEDIUM];
+        int large = hourlyCosts[ParkingSpotType::LARGE], xlarge = hourlyCosts[ParkingSpotType::XLARGE];
+        for (size_t i=0; i<count; i++) {
+            int hours = (now - issuedAt[i]) / (60 * 60);
+            hours = hours == 0 ? 1 : hours;
+            int hourlyCost = spotType[i] == ParkingSpotType::SMALL ? small : spotType[i] == ParkingSpotType::MEDIUM ? medium
+                : spotType[i] == ParkingSpotType::LARGE ? large : xlarge;
+            charge[i] = hours * hourlyCost;
+        }
+    }
+
+public:
+    ExitPanel(ParkingLot *parkingLot, int id)
+    {
+        this->parkingLot = parkingLot;
+        this->id = id;
+        hourlyCosts[ParkingSpotType::SMALL] = 10;
+        hourlyCosts[ParkingSpotType::MEDIUM] = 20;
+        hourlyCosts[ParkingSpotType::LARGE] = 30;
+        hourlyCosts[ParkingSpotType::XLARGE] = 50;
+    }
+
+    ExitPanel(int id): ExitPanel(ParkingLot::getInstance(), id) {}
+
+    /* Returns the settled ticket, the scanned ticket is recycled and must not be used anymore */
+    ParkingTicket scanAndVacate(ParkingTicket *parkingTicket) {
+        parkingTicket->setCharges(calculateCost(parkingTicket));
+        ParkingSpot *parkingSpot = parkingTicket->getAllocatedSpot();
+        if (parkingLot->journal != NULL)
+            parkingLot->journal->logVacate(parkingTicket);
+        parkingLot->vacateParkingSpot(parkingSpot);
+        parkingLot->parkingStrategy->vacateParkingSpot(parkingSpot);
+
+        ParkingTicket settledTicket = *parkingTicket;
+        ObjectPool<ParkingTicket>::getInstance().release(parkingTicket);
+        return settledTicket;
+    }
+
+    /* Settles a batch of tickets at once, e.g. the queue at closing time: one clock read for the batch, the charges
+    computed over flat arrays, one journal sync and the slots handed back to the strategy in bulk. The settled tickets
+    are appended to settledTickets in order, the scanned ones are recycled. */
+    void scanAndVacate(ParkingTicket *const *parkingTickets, size_t count, vector<ParkingTicket> &settledTickets) {
+        issuedAts.resize(count);
+        spotTypes.resize(count);
+        charges.resize(count);
+        parkingSpots.resize(count);
+        for (size_t i=0; i<count; i++) {
+            parkingSpots[i] = parkingTickets[i]->getAllocatedSpot();
+            issuedAts[i] = parkingTickets[i]->getIssuedAt();
+            spotTypes[i] = parkingSpots[i]->getSpotType();
+        }
+        calculateCosts(time(NULL), issuedAts.data(), spotTypes.data(), hourlyCosts, charges.data(), count);
+
+        if (parkingLot->journal != NULL)
+            parkingLot->journal->logVacates(parkingTickets, count);
+        parkingLot->vacateParkingSpots(parkingSpots.data(), count);
+        parkingLot->parkingStrategy->vacateParkingSpots(parkingSpots.data(), count);
+
+        for (size_t i=0; i<count; i++) {
+            parkingTickets[i]->setCharges(charges[i]);
+            settledTickets.push_back(*parkingTickets[i]);
+        }
+        ObjectPool<ParkingTicket>::getInstance().release(parkingTickets, count);
+    }
+};
+
+ParkingLot::~ParkingLot()
+{
+    for (EntrancePanel *entryPanel: entryPanels)
+        delete entryPanel;
+    for (ExitPanel *exitPanel: exitPanels)
+        delete exitPanel;
+    for (ParkingFloor *floor: parkingFloors)
+        delete floor;
+}
+
+/* Payment processor is used to pay parking charges. It can also have different payment strategies
+like Credit Card, Debit Card, UPI, ... */
+class Payment
+{
+    int64_t id;
+    int64_t ticketId;
+    int amount;
+    int initiatedAt;
+    int completedAt;
+
+public:
+    Payment(int64_t id, int64_t ticketId, int amount) {
+        this->id = id;
+        this->ticketId = ticketId;
+        this->amount = amount;
+    }
+
+    void makePayment() {
+        this->initiatedAt = time(NULL);
+        cout << "Payment made successfully of Rs. " << amount << endl;
+        this->completedAt = time(NULL);
+    }
+};
+
+/* =========================================================== */
+/* ================== Parking Lot Registry =================== */
+/* =========================================================== */
+
+/* The lots of an operator running many sites, sharded over worker threads. A lot belongs to the worker of its shard
+(lot id % workers), which runs every request on it one after the other, so the lots keep the lock free
+NormalParkingStrategy and a busy site only holds up its own shard. Requests are closures queued to the worker, which
+takes its whole queue at once. Queries over every lot fan out to all the workers & gather their answers. The closures
+may keep their own per lot state, it is only ever touched by the lot's worker. */
+class ParkingLotRegistry
+{
+    struct Shard {
+        mutex queueMutex;
+        condition_variable queueChanged;
+        vector<function<void()>> queue;
+        vector<ParkingLot*> parkingLots;   // of the worker only, the lot with id i is at i / workers
+        bool isStopping = false;
+        thread worker;
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    mutex addMutex;                        // held while a lot's setup is queued, before its id is counted
+    atomic<int> lotCount{0};
+
+    void post(Shard &shard, function<void()> task) {
+        lock_guard<mutex> lock(shard.queueMutex);
+        shard.queue.push_back(move(task));
+        if (shard.queue.size() == 1)
+            shard.queueChanged.notify_one(); // the worker only waits on an empty queue
+    }
+
+    void run(Shard &shard) {
+        vector<function<void()>> tasks;
+        while (true) {
+            {
+                unique_lock<mutex> lock(shard.queueMutex);
+                shard.queueChanged.wait(lock, [&]() { return !shard.queue.empty() || shard.isStopping; });
+                if (shard.queue.empty())
+                    break;
+                tasks.swap(shard.queue);
+            }
+            for (auto &task: tasks)
+                task();
+            tasks.clear();
+        }
+        for (ParkingLot *parkingLot: shard.parkingLots)
+            delete parkingLot;
+    }
+
+    /* Runs visit on every worker with the lots of its shard and returns once all of them are done */
+    void fanOut(const function<void(vector<ParkingLot*>&)> &visit) {
+        mutex doneMutex;
+        condition_variable allDone;
+        size_t pending = shards.size();
+        for (auto &shard: shards) {
+            Shard *owner = shard.get();
+            post(*owner, [&, owner]() {
+                visit(owner->parkingLots);
+                lock_guard<mutex> lock(doneMutex);
+                if (--pending == 0)
+                    allDone.notify_one();
+            });
+        }
+        unique_lock<mutex> lock(doneMutex);
+        allDone.wait(lock, [&]() { return pending == 0; });
+    }
+
+public:
+    ParkingLotRegistry(int workers) {
+        if (workers <= 0)
+            throw invalid_argument("a registry needs at least one worker");
+        for (int i=0; i<workers; i++)
+            shards.push_back(unique_ptr<Shard>(new Shard()));
+        for (auto &shard: shards) {
+            Shard *owner = shard.get();
+            owner->worker = thread([this, owner]() { run(*owner); });
+        }
+    }
+
+    ParkingLotRegistry(const ParkingLotRegistry&) = delete;
+    ParkingLotRegistry& operator=(const ParkingLotRegistry&) = delete;
+
+    /* Runs the requests already queued, then deletes the lots */
+    ~ParkingLotRegistry() {
+        for (auto &shard: shards) {
+            lock_guard<mutex> lock(shard->queueMutex);
+            shard->isStopping = true;
+            shard->queueChanged.notify_one();
+        }
+        for (auto &shard: shards)
+            shard->worker.join();
+    }
+
+    int getWorkerCount() {
+        return shards.size();
+    }
+
+    int getParkingLotCount() {
+        return lotCount.load(memory_order_relaxed);
+    }
+
+    /* Creates a lot & queues setup (adding its floors, slots & panels) on the lot's worker, ahead of any request on it.
+    Returns the id of the new lot. The id is counted only once setup is queued, so a request submitted for it by another
+    thread can't get ahead of the setup. */
+    int addParkingLot(function<void(ParkingLot&)> setup) {
+        lock_guard<mutex> lock(addMutex);
+        int lotId = lotCount.load(memory_order_relaxed);
+        Shard &shard = *shards[lotId % shards.size()];
+        post(shard, [&shard, lotId, setup]() {
+            shard.parkingLots.push_back(new ParkingLot(lotId)); // ids are handed out in order, so it lands at lotId / workers
+            setup(*shard.parkingLots.back());
+        });
+        lotCount.store(lotId + 1, memory_order_release);
+        return lotId;
+    }
+
+    /* Queues a request on the worker owning the lot (added before by the caller), requests on a lot run in the order
+    they were submitted */
+    void submit(int lotId, function<void(ParkingLot&)> request) {
+        if (lotId < 0 || lotId >= lotCount.load(memory_order_acquire))
+            throw invalid_argument("no parking lot with id " + to_string(lotId));
+        Shard &shard = *shards[lotId % shards.size()];
+        int workers = shards.size();
+        post(shard, [&shard, lotId, workers, request = move(request)]() {
+            request(*shard.parkingLots[lotId / workers]);
+        });
+    }
+
+    /* Ids of the lots with a free slot of the spot type, in order. Answered by every worker from the occupancy boards
+    of its lots once the requests queued before are done. */
+    vector<int> findParkingLots(ParkingSpotType spotType) {
+        mutex foundMutex;
+        vector<int> lotIds;
+        fanOut([&](vector<ParkingLot*> &parkingLots) {
+            vector<int> found;
+            for (ParkingLot *parkingLot: parkingLots) {
+                if (parkingLot->getOccupancyBoard().getFreeSpots(spotType) > 0)
+                    found.push_back(parkingLot->getId());
+            }
+            lock_guard<mutex> lock(foundMutex);
+            lotIds.insert(lotIds.end(), found.begin(), found.end());
+        });
+        sort(lotIds.begin(), lotIds.end());
+        return lotIds;
+    }
+
+    /* Any lot with a free slot of the spot type, -1 if every lot is full */
+    int findParkingLot(ParkingSpotType spotType) {
+        atomic<int> lotId{-1};
+        fanOut([&](vector<ParkingLot*> &parkingLots) {
+            for (ParkingLot *parkingLot: parkingLots) {
+                if (lotId.load(memory_order_relaxed) != -1)
+                    return; // found by another worker
+                if (parkingLot->getOccupancyBoard().getFreeSpots(spotType) > 0) {
+                    lotId.store(parkingLot->getId(), memory_order_relaxed);
+                    return;
+                }
+            }
+        });
+        return lotId;
+    }
+
+    /* Waits for the requests submitted so far to be done */
+    void drain() {
+        fanOut([](vector<ParkingLot*>&) {});
+    }
+};
+
+/* =========================================================== */
+/* ===================== Load Generation ===================== */
+/* =========================================================== */
+
+enum TrafficEventType: uint8_t { ARRIVAL = 1, DEPARTURE };
+
+/* Event of a traffic trace, 16 bytes on disk. A departure is of the vehicle of an earlier arrival. */
+struct TrafficEvent
+{
+    int64_t at;           // nanoseconds since the start of the trace
+    uint32_t vehicleId;   // number of the vehicle in the trace
+    uint8_t type;
+    uint8_t vehicleType;
+    uint16_t unused;
+};
+
+static_assert(sizeof(TrafficEvent) == 16, "trace events are 16 bytes on disk");
+
+/* Shape of generated traffic: Poisson arrivals, log normal dwell times & a mix of vehicle types */
+struct TrafficProfile
+{
+    double arrivalsPerSecond = 100000;
+    double meanDwellSeconds = 0.05;
+    double dwellSigma = 0.5;                 // of the log of the dwell time, the larger the longer the tail
+    double vehicleWeights[4] = {60, 20, 15, 5};   // by vehicle type: CAR, MotorBike, TRUCK, BUS
+};
+
+/* Arrivals & departures of the given number of vehicles, in time order. The same profile & seed give the same trace. */
+vector<TrafficEvent> generateTraffic(const TrafficProfile &profile, uint32_t vehicles, uint32_t seed)
+{
+    mt19937_64 random(seed);
+    exponential_distribution<double> gap(profile.arrivalsPerSecond);
+    // the mean of a log normal is exp(mu + sigma^2 / 2)
+    lognormal_distribution<double> dwell(log(profile.meanDwellSeconds) - profile.dwellSigma * profile.dwellSigma / 2, profile.dwellSigma);
+    discrete_distribution<int> mix(begin(profile.vehicleWeights), end(profile.vehicleWeights));
+
+    vector<TrafficEvent> events;
+    events.reserve(2 * (size_t)vehicles);
+    double at = 0;
+    for (uint32_t vehicleId=0; vehicleId<vehicles; vehicleId++) {
+        at += gap(random);
+        uint8_t vehicleType = mix(random);
+        int64_t arrivalAt = (int64_t)(at * 1e9);
+        events.push_back(TrafficEvent{arrivalAt, vehicleId, ARRIVAL, vehicleType, 0});
+        events.push_back(TrafficEvent{arrivalAt + 1 + (int64_t)(dwell(random) * 1e9), vehicleId, DEPARTURE, vehicleType, 0});
+    }
+    stable_sort(events.begin(), events.end(), [](const TrafficEvent &a, const TrafficEvent &b) { return a.at < b.at; });
+    return events;
+}
+
+const char TRACE_MAGIC[8] = {'P', 'T', 'R', 'A', 'C', 'E', '0', '1'};
+
+/* A trace file is the magic, the number of events & the events */
+void writeTrace(const string &path, const vector<TrafficEvent> &events)
+{
+    ofstream file(path, ios::binary | ios::trunc);
+    uint64_t count = events.size();
+    file.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    file.write((const char*)&count, sizeof(count));
+    file.write((const char*)events.data(), count * sizeof(TrafficEvent));
+    if (!file.flush())
+        throw runtime_error("can't write trace " + path);
+}
+
+vector<TrafficEvent> readTrace(const string &path)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        throw runtime_error("can't open trace " + path);
+    char magic[sizeof(TRACE_MAGIC)];
+    uint64_t count = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&count, sizeof(count));
+    if (!file || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+        throw runtime_error(path + " is not a trace");
+
+    // the count is checked against the size of the file before anything is allocated for it
+    streamoff header = file.tellg();
+    file.seekg(0, ios::end);
+    uint64_t available = file.tellg() - header;
+    file.seekg(header);
+    if (count > available / sizeof(TrafficEvent))
+        throw runtime_error("trace " + path + " is truncated");
+
+    vector<TrafficEvent> events(count);
+    file.read((char*)events.data(), count * sizeof(TrafficEvent));
+    if ((uint64_t)file.gcount() != count * sizeof(TrafficEvent))
+        throw runtime_error("trace " + path + " is truncated");
+
+    // vehicle ids size the tables of the gates & vehicle types index their vehicles. A gate keeps one ticket per vehicle,
+    // so every vehicle arrives once & departs at most once, after it arrived.
+    vector<uint8_t> seen(count, 0);    // events of each vehicle so far, its arrival & then its departure
+    for (const TrafficEvent &event: events) {
+        if ((event.type != ARRIVAL && event.type != DEPARTURE) || event.vehicleType > VehicleType::BUS || event.vehicleId >= count)
+            throw runtime_error("trace " + path + " is corrupt");
+        uint8_t &vehicleEvents = seen[event.vehicleId];
+        if (vehicleEvents != (event.type == ARRIVAL ? 0 : 1))
+            throw runtime_error("trace " + path + " is corrupt, vehicle " + to_string(event.vehicleId) + " arrives twice or departs without arriving");
+        vehicleEvents++;
+    }
+    return events;
+}
+
+/* Latencies in nanoseconds, counted in 16 buckets per power of two, so a percentile is off by at most 1/16 of its
+value. Recording is a few shifts & an increment. */
+class LatencyHistogram
+{
+    static const int SUB_BITS = 4;
+    static const int BUCKETS = (64 - SUB_BITS) << SUB_BITS;
+
+    vector<uint64_t> counts = vector<uint64_t>(BUCKETS, 0);
+    uint64_t count = 0;
+    uint64_t maxValue = 0;
+    double sum = 0;
+
+    static int getBucket(uint64_t value) {
+        if (value < (1 << SUB_BITS))
+            return value;
+        int exponent = 63 - __builtin_clzll(value);
+        return (exponent - SUB_BITS + 1) << SUB_BITS | ((value >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+    }
+
+    /* Largest value counted in the bucket */
+    static uint64_t getBucketTop(int bucket) {
+        if (bucket < (1 << SUB_BITS))
+            return bucket;
+        int shift = (bucket >> SUB_BITS) - 1;
+        uint64_t mantissa = (bucket & ((1 << SUB_BITS) - 1)) | (1 << SUB_BITS);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+public:
+    void record(uint64_t nanos) {
+        counts[getBucket(nanos)]++;
+        count++;
+        maxValue = max(maxValue, nanos);
+        sum += nanos;
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (int i=0; i<BUCKETS; i++)
+            counts[i] += other.counts[i];
+        count += other.count;
+        maxValue = max(maxValue, other.maxValue);
+        sum += other.sum;
+    }
+
+    uint64_t getCount() {
+        return count;
+    }
+
+    double getMean() {
+        return count == 0 ? 0 : sum / count;
+    }
+
+    uint64_t getMax() {
+        return maxValue;
+    }
+
+    /* Latency under which the given fraction of the recorded latencies fall */
+    uint64_t getPercentile(double fraction) {
+        uint64_t rank = (uint64_t)ceil(fraction * count), seen = 0;
+        for (int i=0; i<BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank && seen > 0)
+                return min(getBucketTop(i), maxValue);
+        }
+        return maxValue;
+    }
+};
+
+/* Outcome of running a trace */
+struct TrafficReport
+{
+    long long arrivals = 0;
+    long long departures = 0;
+    long long rejected = 0;    // arrivals finding the lot full, their departures are skipped
+    double seconds = 0;
+    double offeredSeconds = 0; // span of the trace at the speed it was run
+    LatencyHistogram entryLatency;
+    LatencyHistogram exitLatency;
+    long long liveTickets = 0; // left in the ticket pool after the run
+    size_t ticketSlabs = 0;
+    size_t spotSlabs = 0;
+    size_t heapBytes = 0;      // in use by malloc after the run
+};
+
+/* Plays a trace through the entrance & exit panels of a lot in open loop: every event is sent at its time in the trace
+(divided by speedup) whether or not the lot kept up, and its latency is measured from that time, so the time an event
+waits behind a late one counts. The vehicles are split over the gates, each on its own thread with its own panels, by
+vehicle number so that a departure is at the gate of its arrival. The lot's strategy must allow concurrent gates when
+gates > 1. */
+TrafficReport runTraffic(ParkingLot *parkingLot, const vector<TrafficEvent> &events, int gates, double speedup = 1)
+{
+    vector<vector<const TrafficEvent*>> gateEvents(gates);
+    uint32_t vehicles = 0;
+    for (const TrafficEvent &event: events) {
+        gateEvents[event.vehicleId % gates].push_back(&event);
+        vehicles = max(vehicles, event.vehicleId + 1);
+    }
+
+    TrafficReport report;
+    vector<TrafficReport> gateReports(gates);
+    auto start = chrono::steady_clock::now() + chrono::milliseconds(1);
+    vector<thread> pool;
+    for (int gate=0; gate<gates; gate++) {
+        pool.push_back(thread([&, gate]() {
+            EntrancePanel entrance(parkingLot, gate + 1);
+            ExitPanel exitPanel(parkingLot, gate + 1);
+            Vehicle gateVehicles[] = {Vehicle("CAR" + to_string(gate), VehicleType::CAR), Vehicle("BIKE" + to_string(gate), VehicleType::MotorBike),
+                Vehicle("TRUCK" + to_string(gate), VehicleType::TRUCK), Vehicle("BUS" + to_string(gate), VehicleType::BUS)};
+            vector<ParkingTicket*> tickets(vehicles / gates + 1, NULL);   // by vehicle number / gates
+            TrafficReport &gateReport = gateReports[gate];
+
+            for (const TrafficEvent *event: gateEvents[gate]) {
+                auto due = start + chrono::nanoseconds((int64_t)(event->at / speedup));
+                auto now = chrono::steady_clock::now();
+                if (due - now > chrono::microseconds(200))
+                    this_thread::sleep_for(due - now - chrono::microseconds(100));
+                while (chrono::steady_clock::now() < due)
+                    this_thread::yield();
+
+                ParkingTicket *&parkingTicket = tickets[event->vehicleId / gates];
+                if (event->type == ARRIVAL) {
+                    parkingTicket = entrance.getParkingTicket(&gateVehicles[event->vehicleType]);
+                    gateReport.arrivals++;
+                    if (parkingTicket == NULL)
+                        gateReport.rejected++;
+                    gateReport.entryLatency.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - due).count());
+                } else if (parkingTicket != NULL) {
+                    exitPanel.scanAndVacate(parkingTicket);
+                    parkingTicket = NULL;
+                    gateReport.departures++;
+                    gateReport.exitLatency.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - due).count());
+                }
+            }
+        }));
+    }
+    for (auto &gate: pool)
+        gate.join();
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    report.offeredSeconds = events.empty() ? 0 : events.back().at / speedup / 1e9;
+
+    for (TrafficReport &gateReport: gateReports) {
+        report.arrivals += gateReport.arrivals;
+        report.departures += gateReport.departures;
+        report.rejected += gateReport.rejected;
+        report.entryLatency.merge(gateReport.entryLatency);
+        report.exitLatency.merge(gateReport.exitLatency);
+    }
+    report.liveTickets = ObjectPool<ParkingTicket>::getInstance().getLiveCount();
+    report.ticketSlabs = ObjectPool<ParkingTicket>::getInstance().getSlabCount();
+    report.spotSlabs = ObjectPool<ParkingSpot>::getInstance().getSlabCount();
+    report.heapBytes = mallinfo2().uordblks;
+    return report;
+}
+
+void printTrafficReport(TrafficReport &report)
+{
+    long long events = report.arrivals + report.departures;
+    cout << "events " << events << " in " << report.seconds << " s (" << (long long)(events / report.seconds) << "/s, offered "
+        << (long long)(report.offeredSeconds == 0 ? 0 : events / report.offeredSeconds) << "/s), arrivals " << report.arrivals
+        << ", rejected " << report.rejected << endl;
+    cout << "latency us\tmean\tp50\tp90\tp99\tp99.9\tmax" << endl;
+    for (int exits=0; exits<2; exits++) {
+        LatencyHistogram &latency = exits ? report.exitLatency : report.entryLatency;
+        cout << (exits ? "exit" : "entry") << "\t\t" << latency.getMean() / 1000;
+        for (double fraction: {0.5, 0.9, 0.99, 0.999})
+            cout << "\t" << latency.getPercentile(fraction) / 1000.0;
+        cout << "\t" << latency.getMax() / 1000.0 << endl;
+    }
+    cout << "live tickets " << report.liveTickets << ", ticket slabs " << report.ticketSlabs << ", spot slabs "
+        << report.spotSlabs << ", heap in use " << report.heapBytes / 1024 << " KB" << endl;
+}
+
+/* =========================================================== */
+/* ======================== Benchmarks ======================= */
+/* =========================================================== */
+
+/* Lots of 10k, 100k & 1M spots on floors of 100 spots kept at 90% occupancy: every iteration vacates a random parked
+vehicle and parks a new one of the same spot type, which lands on the lowest floor with a free spot */
+void benchmarkAllocator()
+{
+    const int spotsPerFloor = 100;
+    const int iterations = 1000000;
+    mt19937 rng(42);
+
+    cout << "spots\tfloors\tns/park+vacate\tns/availability check" << endl;
+    for (int spots: {10000, 100000, 1000000}) {
+        int floors = spots / spotsPerFloor;
+        NormalParkingStrategy strategy;
+        for (int floorId=1; floorId<=floors; floorId++) {
+            for (int i=0; i<spotsPerFloor; i++)
+                strategy.addParkingSpot(floorId, (ParkingSpotType)(i % PARKING_SPOT_TYPE_COUNT));
+        }
+
+        vector<ParkingSpot*> parked;
+        for (int i=0; i<spots*9/10; i++)
+            parked.push_back(strategy.getParkingSpot((ParkingSpotType)(i % PARKING_SPOT_TYPE_COUNT)));
+
+        uniform_int_distribution<int> anyParked(0, parked.size() - 1);
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++) {
+            ParkingSpot *&parkingSpot = parked[anyParked(rng)];
+            ParkingSpotType spotType = parkingSpot->getSpotType();
+            strategy.vacateParkingSpot(parkingSpot);
+            parkingSpot = strategy.getParkingSpot(spotType);
+        }
+        double parkNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+
+        int available = 0;
+        start = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++)
+            available += strategy.isParkingSpotAvailable((ParkingSpotType)(i % PARKING_SPOT_TYPE_COUNT));
+        double checkNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+
+        if (available != iterations)
+            cout << "spots should be available on every check" << endl;
+        cout << spots << "\t" << floors << "\t" << parkNs << "\t\t" << checkNs << endl;
+    }
+}
+
+/* Slots laid out on floors of 100 x 100 slots of 2.5 x 5 m, four gates at the corners of the first floor, the lot kept
+at 90% occupancy as in benchmarkAllocator: every iteration vacates a random parked vehicle and parks a new one coming in
+through a random gate. NormalParkingStrategy ignores the gates, the distance column is how far from its gate the
+average vehicle gets parked. In the last run of every size vehicles come in from random positions of the first floor
+instead of the gates, so NearestParkingStrategy has to search its SpotTrees. */
+void benchmarkNearest()
+{
+    const int spotsPerFloor = 10000;
+    const int iterations = 1000000;
+    const float floorDistance = 50;
+    const Position gates[] = {{0, 0}, {250, 0}, {0, 500}, {250, 500}};
+
+    cout << "spots\tstrategy\tns/park+vacate\taverage distance m" << endl;
+    for (int spots: {10000, 100000, 1000000}) {
+        for (string name: {"normal", "nearest", "nearest, any position"}) {
+            mt19937 rng(42);
+            bool isAnyPosition = name == "nearest, any position";
+            unique_ptr<ParkingStrategy> strategy(ParkingStrategyFactory::createParkingStrategy(isAnyPosition ? "nearest" : name));
+            for (int i=0; i<spots; i++) {
+                int spot = i % spotsPerFloor;
+                Position position = {(spot % 100) * 2.5f, (spot / 100) * 5.0f};
+                strategy->addParkingSpot(1 + i / spotsPerFloor, (ParkingSpotType)(spot % 2), position);
+            }
+            for (Position gate: gates)
+                strategy->addGate(1, gate);
+
+            auto getDistance = [&](ParkingSpot *parkingSpot, Position gate) {
+                Position position = parkingSpot->getPosition();
+                float dx = position.x - gate.x, dy = position.y - gate.y;
+                return floorDistance * (parkingSpot->getFloorId() - 1) + sqrt(dx * dx + dy * dy);
+            };
+
+            vector<ParkingSpot*> parked;
+            for (int i=0; i<spots*9/10; i++)
+                parked.push_back(strategy->getParkingSpot((ParkingSpotType)(i % 2), 1, gates[i % 4]));
+
+            uniform_int_distribution<int> anyParked(0, parked.size() - 1);
+            double distance = 0;
+            auto start = chrono::steady_clock::now();
+            for (int i=0; i<iterations; i++) {
+                int index = anyParked(rng);
+                ParkingSpotType spotType = parked[index]->getSpotType();
+                strategy->vacateParkingSpot(parked[index]);
+                Position gate = isAnyPosition ? Position{(float)(rng() % 250), (float)(rng() % 500)} : gates[rng() % 4];
+                parked[index] = strategy->getParkingSpot(spotType, 1, gate);
+                distance += getDistance(parked[index], gate);
+            }
+            double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+            cout << spots << "\t" << name << (isAnyPosition ? "\t" : "\t\t") << ns << "\t\t" << distance / iterations << endl;
+        }
+    }
+}
+
+/* Gates on their own threads parking & vacating through a ConcurrentParkingStrategy. Every gate keeps up to 64
+tickets and vacates its oldest one once it holds 64 or the lot is full. A per spot counter of the vehicles parked on it
+catches a spot allotted twice; on a small lot the gates keep running out of spots and race for the last ones. */
+void benchmarkGates()
+{
+    const int iterations = 200000;
+    const int ticketsPerGate = 64;
+
+    ParkingStrategy *previousStrategy = ParkingLot::getInstance()->parkingStrategy;
+    cout << "spots\tgates\ttickets/s\tfull lot\tdouble allotments" << endl;
+    for (int spots: {64, 100000}) {
+        for (int gates: {1, 2, 4, 8}) {
+            ConcurrentParkingStrategy strategy(spots);
+            for (int i=0; i<spots; i++)
+                strategy.addParkingSpot(1 + i / 100, (ParkingSpotType)(i % PARKING_SPOT_TYPE_COUNT));
+            ParkingLot::getInstance()->setParkingStrategy(&strategy);
+
+            unordered_map<ParkingSpot*, int> spotIndexes;
+            for (size_t i=0; i<strategy.getSpotCount(); i++)
+                spotIndexes[strategy.getSpot(i)] = i;
+            unique_ptr<atomic<int>[]> vehiclesOnSpot(new atomic<int>[spots]());
+
+            atomic<long long> tickets{0}, fullLot{0}, doubleAllotments{0};
+            auto gate = [&](int id) {
+                EntrancePanel entrance(id);
+                ExitPanel exitPanel(id);
+                Vehicle car("KA01" + to_string(id), VehicleType::CAR);
+                Vehicle bike("KA02" + to_string(id), VehicleType::MotorBike);
+                deque<ParkingTicket*> held;
+
+                for (int i=0; i<iterations; i++) {
+                    ParkingTicket *parkingTicket = entrance.getParkingTicket(i % 2 == 0 ? &car : &bike);
+                    if (parkingTicket != NULL) {
+                        if (vehiclesOnSpot[spotIndexes.at(parkingTicket->getAllocatedSpot())].fetch_add(1) != 0)
+                            doubleAllotments++;
+                        held.push_back(parkingTicket);
+                        tickets++;
+                    } else {
+                        fullLot++;
+                    }
+
+                    if (held.size() == ticketsPerGate || (parkingTicket == NULL && !held.empty())) {
+                        ParkingTicket *oldest = held.front();
+                        held.pop_front();
+                        vehiclesOnSpot[spotIndexes.at(oldest->getAllocatedSpot())]--;
+                        exitPanel.scanAndVacate(oldest);
+                    }
+                }
+                for (ParkingTicket *parkingTicket: held) {
+                    vehiclesOnSpot[spotIndexes.at(parkingTicket->getAllocatedSpot())]--;
+                    exitPanel.scanAndVacate(parkingTicket);
+                }
+            };
+
+            auto start = chrono::steady_clock::now();
+            vector<thread> pool;
+            for (int i=0; i<gates; i++)
+                pool.push_back(thread(gate, i + 1));
+            for (auto &worker: pool)
+                worker.join();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            for (int i=0; i<PARKING_SPOT_TYPE_COUNT; i++) {
+                if (!strategy.isParkingSpotAvailable((ParkingSpotType)i))
+                    cout << "every spot should be available again once the gates are done" << endl;
+            }
+            cout << spots << "\t" << gates << "\t" << (long long)(tickets / seconds) << "\t" << fullLot << "\t\t"
+                << doubleAllotments << endl;
+        }
+    }
+    ParkingLot::getInstance()->setParkingStrategy(previousStrategy);
+}
+
+/* Closing time: n parked vehicles leave through one exit panel, either one ticket after the other or as one batch.
+Every run parks the n vehicles again, a lot of 200k slots on floors of 100 with NormalParkingStrategy & then with
+ConcurrentParkingStrategy, which takes the batch back with a single push per spot type. */
+void benchmarkExits()
+{
+    const int spots = 200000;
+    const int ticketsPerSize = 1000000;
+
+    ParkingLot *parkingLot = ParkingLot::getInstance();
+    ParkingStrategy *previousStrategy = parkingLot->parkingStrategy;
+    cout << "strategy\ttickets\tns/ticket one by one\tns/ticket batched" << endl;
+    for (string name: {"normal", "concurrent"}) {
+        for (int tickets: {1000, 10000, 100000}) {
+            unique_ptr<ParkingStrategy> strategy(ParkingStrategyFactory::createParkingStrategy(name));
+            for (int i=0; i<spots; i++)
+                strategy->addParkingSpot(1 + i / 100, (ParkingSpotType)(i % PARKING_SPOT_TYPE_COUNT));
+            parkingLot->setParkingStrategy(strategy.get());
+
+            EntrancePanel entrance(1);
+            ExitPanel exitPanel(1);
+            vector<Vehicle> vehicles;
+            for (int i=0; i<tickets; i++)
+                vehicles.push_back(Vehicle("KA" + to_string(i), (VehicleType)(i % 4)));
+            vector<ParkingTicket*> parked(tickets);
+            vector<ParkingTicket> settledTickets;
+            settledTickets.reserve(tickets);
+
+            double seconds[2] = {0, 0};
+            long long charges[2] = {0, 0};
+            for (int round=0; round<ticketsPerSize/tickets; round++) {
+                for (int batched=0; batched<2; batched++) {
+                    for (int i=0; i<tickets; i++)
+                        parked[i] = entrance.getParkingTicket(&vehicles[i]);
+                    settledTickets.clear();
+
+                    auto start = chrono::steady_clock::now();
+                    if (batched) {
+                        exitPanel.scanAndVacate(parked.data(), tickets, settledTickets);
+                    } else {
+                        for (int i=0; i<tickets; i++)
+                            settledTickets.push_back(exitPanel.scanAndVacate(parked[i]));
+                    }
+                    seconds[batched] += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                    for (ParkingTicket &settledTicket: settledTickets)
+                        charges[batched] += settledTicket.getCharges();
+                }
+            }
+            if (charges[0] != charges[1])
+                cout << "batched charges should match the ones of single tickets" << endl;
+
+            int rounds = ticketsPerSize / tickets;
+            cout << name << (name == "normal" ? "\t\t" : "\t") << tickets << "\t" << seconds[0] * 1e9 / rounds / tickets << "\t\t\t"
+                << seconds[1] * 1e9 / rounds / tickets << endl;
+        }
+    }
+    parkingLot->setParkingStrategy(previousStrategy);
+}
+
+/* Resident set size of the process in KB */
+long getResidentKb()
+{
+    long pages = 0, residentPages = 0;
+    ifstream statm("/proc/self/statm");
+    statm >> pages >> residentPages;
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* A day of traffic through one gate pair of a lot with 100k spots half full: every simulated minute 5000 vehicles leave
+and 5000 arrive. With vehicles, tickets & spots recycled through their pools the memory stays flat after the first hour. */
+void soakTest()
+{
+    const int spots = 100000;
+    const int vehiclesPerMinute = 5000;
+    mt19937 rng(7);
+
+    NormalParkingStrategy strategy;
+    ParkingStrategy *previousStrategy = ParkingLot::getInstance()->parkingStrategy;
+    for (int i=0; i<spots; i++)
+        strategy.addParkingSpot(1 + i / 1000, (i % 2 == 0) ? ParkingSpotType::MEDIUM : ParkingSpotType::SMALL);
+    ParkingLot::getInstance()->setParkingStrategy(&strategy);
+
+    EntrancePanel entrance(1);
+    ExitPanel exitPanel(1);
+    vector<ParkingTicket*> parked;
+    long long entries = 0;
+    auto enter = [&]() {
+        VehicleType vehicleType = rng() % 2 == 0 ? VehicleType::CAR : VehicleType::MotorBike;
+        Vehicle *vehicle = VehicleFactory::createVehicle("KA" + to_string(entries++), vehicleType);
+        ParkingTicket *parkingTicket = entrance.getParkingTicket(vehicle);
+        if (parkingTicket == NULL)
+            VehicleFactory::releaseVehicle(vehicle);
+        else
+            parked.push_back(parkingTicket);
+    };
+
+    for (int i=0; i<spots/2; i++)
+        enter();
+
+    cout << "hour\tentries\tparked\tticket slabs\tvehicle slabs\tspot slabs\tRSS KB" << endl;
+    auto start = chrono::steady_clock::now();
+    for (int minute=1; minute<=24*60; minute++) {
+        for (int i=0; i<vehiclesPerMinute; i++) {
+            size_t index = rng() % parked.size();
+            ParkingTicket settledTicket = exitPanel.scanAndVacate(parked[index]);
+            VehicleFactory::releaseVehicle(settledTicket.getVehicle());
+            parked[index] = parked.back();
+            parked.pop_back();
+        }
+        for (int i=0; i<vehiclesPerMinute; i++)
+            enter();
+
+        if (minute % (4 * 60) == 0)
+            cout << minute / 60 << "\t" << entries << "\t" << parked.size() << "\t" << ObjectPool<ParkingTicket>::getInstance().getSlabCount()
+                << "\t\t" << ObjectPool<Vehicle>::getInstance().getSlabCount() << "\t\t" << ObjectPool<ParkingSpot>::getInstance().getSlabCount()
+                << "\t\t" << getResidentKb() << endl;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "simulated day took " << seconds << " s, " << (long long)(2 * vehiclesPerMinute * 24 * 60 / seconds) << " entries & exits/s" << endl;
+
+    for (ParkingTicket *parkingTicket: parked)
+        VehicleFactory::releaseVehicle(exitPanel.scanAndVacate(parkingTicket).getVehicle());
+    ParkingLot::getInstance()->setParkingStrategy(previousStrategy);
+}
+
+/* Ids/s from the shared IdGenerator for a growing number of threads, all the ids of a run are sorted to check that
+none was handed out twice */
+void benchmarkIdGenerator()
+{
+    const int idsPerThread = 10000000;
+
+    cout << "threads\tids\tids/s\tduplicates" << endl;
+    for (int threads: {1, 2, 4, 8}) {
+        vector<vector<int64_t>> ids(threads, vector<int64_t>(idsPerThread));
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (int i=0; i<threads; i++) {
+            pool.push_back(thread([&ids, i]() {
+                IdGenerator &generator = IdGenerator::getInstance();
+                for (int64_t &id: ids[i])
+                    id = generator.nextId();
+            }));
+        }
+        for (auto &worker: pool)
+            worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        vector<int64_t> all;
+        all.reserve((size_t)threads * idsPerThread);
+        for (auto &threadIds: ids)
+            all.insert(all.end(), threadIds.begin(), threadIds.end());
+        sort(all.begin(), all.end());
+        size_t duplicates = all.size() - (unique(all.begin(), all.end()) - all.begin());
+
+        cout << threads << "\t" << (size_t)threads * idsPerThread << "\t" << (long long)(threads * idsPerThread / seconds)
+            << "\t" << duplicates << endl;
+    }
+}
+
+/* Removes the snapshot & log segments of a journal */
+void removeJournalFiles(string basePath)
+{
+    filesystem::path base(basePath);
+    for (auto &entry: filesystem::directory_iterator(base.parent_path())) {
+        if (entry.path().filename().string().rfind(base.filename().string() + ".", 0) == 0)
+            filesystem::remove(entry.path());
+    }
+}
+
+/* A crash in the middle of an append: the last record of the log is cut in half, recovery has to stop before it and
+get back every ticket logged before it */
+void checkJournalTornTail(string basePath)
+{
+    removeJournalFiles(basePath);
+    ParkingLot *parkingLot = ParkingLot::getInstance();
+    ParkingStrategy *previousStrategy = parkingLot->parkingStrategy;
+    if (parkingLot->getParkingFloor(1) == NULL)
+        parkingLot->addParkingFloor(new ParkingFloor(1));
+
+    vector<ParkingTicket*> parked;
+    {
+        NormalParkingStrategy strategy;
+        ParkingJournal journal(basePath, chrono::hours(1));
+        journal.recover(strategy);
+        parkingLot->setParkingStrategy(&strategy);
+        parkingLot->setJournal(&journal);
+        parkingLot->addParkingSpots(1, ParkingSpotType::MEDIUM, 4);
+        EntrancePanel entrance(1);
+        for (int i=0; i<3; i++)
+            parked.push_back(entrance.getParkingTicket(VehicleFactory::createVehicle("TORN" + to_string(i), VehicleType::CAR)));
+        parkingLot->setJournal(NULL);
+        parkingLot->setParkingStrategy(previousStrategy);
+    }
+    for (ParkingTicket *parkingTicket: parked) {
+        VehicleFactory::releaseVehicle(parkingTicket->getVehicle());
+        ObjectPool<ParkingTicket>::getInstance().release(parkingTicket);
+    }
+
+    filesystem::path lastSegment;
+    for (auto &entry: filesystem::directory_iterator(filesystem::path(basePath).parent_path())) {
+        string name = entry.path().string();
+        if (name.rfind(basePath + ".", 0) == 0 && entry.path().extension() == ".wal" && name > lastSegment.string())
+            lastSegment = entry.path();
+    }
+    filesystem::resize_file(lastSegment, filesystem::file_size(lastSegment) - sizeof(JournalRecord) / 2);
+
+    NormalParkingStrategy strategy;
+    vector<ParkingTicket*> recovered;
+    {
+        ParkingJournal journal(basePath, chrono::hours(1));
+        recovered = journal.recover(strategy);
+    }
+    size_t availableSlots = 0;
+    while (strategy.getParkingSpot(ParkingSpotType::MEDIUM) != NULL)
+        availableSlots++;
+    cout << "torn log tail: " << recovered.size() << " of " << parked.size() << " tickets recovered, " << availableSlots
+        << " slots free" << (recovered.size() == parked.size() - 1 && availableSlots == 2 ? "" : ", expected 2 tickets & 2 slots") << endl;
+
+    for (ParkingTicket *parkingTicket: recovered) {
+        VehicleFactory::releaseVehicle(parkingTicket->getVehicle());
+        ObjectPool<ParkingTicket>::getInstance().release(parkingTicket);
+    }
+    parkingLot->getParkingFloor(1)->vacateAllParkingSpots();
+    removeJournalFiles(basePath);
+}
+
+/* Gates on their own threads parking through a journaled lot until it holds 1M open tickets, then a restart.
+Commit latency is how long a gate waits for its ticket, the fdatasync of its record included: the more gates, the more
+records a single sync covers. The full lot is snapshotted, goes through a log tail of 100k exits & 100k entries and is
+recovered into a fresh NormalParkingStrategy from the snapshot plus the tail, then once more from the snapshot alone. */
+void benchmarkJournal()
+{
+    const int openTickets = 1000000;
+    const int spotsPerFloor = 1000;
+    const int spots = openTickets + openTickets / 20;
+    const int tailExits = 100000;
+    const string basePath = "/tmp/parking-journal-bench";
+
+    removeJournalFiles(basePath);
+    ParkingLot *parkingLot = ParkingLot::getInstance();
+    ParkingStrategy *previousStrategy = parkingLot->parkingStrategy;
+    for (int floorId=1; floorId<=spots/spotsPerFloor; floorId++) {
+        if (parkingLot->getParkingFloor(floorId) == NULL)
+            parkingLot->addParkingFloor(new ParkingFloor(floorId));
+    }
+
+    vector<ParkingTicket*> parked;
+    {
+        ConcurrentParkingStrategy strategy(spots);
+        ParkingJournal journal(basePath, chrono::hours(1));
+        journal.recover(strategy);
+        parkingLot->setParkingStrategy(&strategy);
+        parkingLot->setJournal(&journal);
+        for (int floorId=1; floorId<=spots/spotsPerFloor; floorId++) {
+            parkingLot->addParkingSpots(floorId, ParkingSpotType::MEDIUM, spotsPerFloor / 2);
+            parkingLot->addParkingSpots(floorId, ParkingSpotType::SMALL, spotsPerFloor / 2);
+        }
+
+        cout << "gates\ttickets\ttickets/s\tp50 us\tp99 us\trecords/sync" << endl;
+        atomic<long long> vehicles{0};
+        for (int gates: {1, 4, 16, 64, 256}) {
+            int tickets = gates == 256 ? openTickets - parked.size() : 5000 * gates;
+            vector<vector<double>> latencies(gates);
+            vector<vector<ParkingTicket*>> gateTickets(gates);
+            uint64_t syncs = journal.getSyncCount(), syncedRecords = journal.getSyncedRecordCount();
+
+            auto start = chrono::steady_clock::now();
+            vector<thread> pool;
+            for (int i=0; i<gates; i++) {
+                pool.push_back(thread([&, i]() {
+                    EntrancePanel entrance(i + 1);
+                    for (int j=i; j<tickets; j+=gates) {
+                        long long number = vehicles++;
+                        Vehicle *vehicle = VehicleFactory::createVehicle("KA" + to_string(number), number % 2 == 0 ? VehicleType::CAR : VehicleType::MotorBike);
+                        auto issued = chrono::steady_clock::now();
+                        gateTickets[i].push_back(entrance.getParkingTicket(vehicle));
+                        latencies[i].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - issued).count());
+                    }
+                }));
+            }
+            for (auto &worker: pool)
+                worker.join();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            vector<double> all;
+            for (int i=0; i<gates; i++) {
+                all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+                parked.insert(parked.end(), gateTickets[i].begin(), gateTickets[i].end());
+            }
+            sort(all.begin(), all.end());
+            cout << gates << "\t" << tickets << "\t" << (long long)(tickets / seconds) << "\t\t" << all[all.size() / 2] << "\t"
+                << all[all.size() * 99 / 100] << "\t" << (double)(journal.getSyncedRecordCount() - syncedRecords) / (journal.getSyncCount() - syncs) << endl;
+        }
+        if (count(parked.begin(), parked.end(), (ParkingTicket*)NULL) != 0)
+            cout << "every vehicle should have been parked" << endl;
+
+        auto start = chrono::steady_clock::now();
+        journal.snapshot();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "snapshot of " << journal.getOpenTicketCount() << " open tickets took " << seconds * 1000 << " ms, "
+            << filesystem::file_size(basePath + ".snapshot") / (1 << 20) << " MB" << endl;
+
+        // log tail: every exit is followed by an entry, so the lot stays at 1M open tickets
+        const int gates = 64;
+        mt19937 rng(11);
+        shuffle(parked.begin(), parked.end(), rng);
+        start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (int i=0; i<gates; i++) {
+            pool.push_back(thread([&, i]() {
+                EntrancePanel entrance(i + 1);
+                ExitPanel exitPanel(i + 1);
+                for (int j=i; j<tailExits; j+=gates) {
+                    ParkingTicket settledTicket = exitPanel.scanAndVacate(parked[j]);
+                    VehicleType vehicleType = settledTicket.getVehicle()->getType();
+                    VehicleFactory::releaseVehicle(settledTicket.getVehicle());
+                    parked[j] = entrance.getParkingTicket(VehicleFactory::createVehicle("KA" + to_string(vehicles++), vehicleType));
+                }
+            }));
+        }
+        for (auto &worker: pool)
+            worker.join();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "log tail of " << 2 * tailExits << " records written at " << (long long)(2 * tailExits / seconds) << " records/s" << endl;
+
+        parkingLot->setJournal(NULL);
+        parkingLot->setParkingStrategy(previousStrategy);
+        for (ParkingTicket *parkingTicket: parked) {
+            VehicleFactory::releaseVehicle(parkingTicket->getVehicle());
+            ObjectPool<ParkingTicket>::getInstance().release(parkingTicket);
+        }
+    }
+
+    cout << "recovery\t\topen tickets\toccupied slots\tseconds" << endl;
+    for (string source: {"snapshot + log tail", "snapshot"}) {
+        NormalParkingStrategy strategy;
+        auto start = chrono::steady_clock::now();
+        vector<ParkingTicket*> recovered;
+        {
+            ParkingJournal journal(basePath, chrono::hours(1));
+            recovered = journal.recover(strategy);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        size_t occupiedSlots = 0;
+        for (ParkingFloor *floor: parkingLot->getParkingFloors())
+            occupiedSlots += floor->getOccupiedCount();
+        cout << source << "\t" << (source == "snapshot" ? "\t" : "") << recovered.size() << "\t\t" << occupiedSlots << "\t\t"
+            << seconds << endl;
+
+        for (ParkingTicket *parkingTicket: recovered) {
+            VehicleFactory::releaseVehicle(parkingTicket->getVehicle());
+            ObjectPool<ParkingTicket>::getInstance().release(parkingTicket);
+        }
+    }
+    for (ParkingFloor *floor: parkingLot->getParkingFloors())
+        floor->vacateAllParkingSpots();
+    removeJournalFiles(basePath);
+
+    checkJournalTornTail(basePath);
+}
+
+/* Readers of the occupancy board next to gates parking & vacating on their own threads: the cost of a snapshot & of a
+count for the readers, and the tickets/s of the gates with & without readers following the feed & taking a snapshot
+every 1000 polls. Once the gates are done every count has to be back to all the slots free. */
+void benchmarkOccupancy()
+{
+    const int floors = 100;
+    const int spotsPerFloor = 1000;
+    const int iterations = 200000;
+    const int gates = 4;
+
+    ParkingLot *parkingLot = ParkingLot::getInstance();
+    OccupancyBoard &board = parkingLot->getOccupancyBoard();
+    ParkingStrategy *previousStrategy = parkingLot->parkingStrategy;
+    board.clear();
+    for (int floorId=1; floorId<=floors; floorId++) {
+        if (parkingLot->getParkingFloor(floorId) == NULL)
+            parkingLot->addParkingFloor(new ParkingFloor(floorId));
+    }
+
+    ConcurrentParkingStrategy strategy(floors * spotsPerFloor);
+    parkingLot->setParkingStrategy(&strategy);
+    for (int floorId=1; floorId<=floors; floorId++) {
+        parkingLot->addParkingSpots(floorId, ParkingSpotType::MEDIUM, spotsPerFloor / 2);
+        parkingLot->addParkingSpots(floorId, ParkingSpotType::SMALL, spotsPerFloor / 2);
+    }
+
+    const int reads = 1000000;
+    long long sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<reads/100; i++)
+        sink += board.getSnapshot().size();
+    double snapshotNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (reads / 100);
+    start = chrono::steady_clock::now();
+    for (int i=0; i<reads; i++)
+        sink += board.getFreeSpots(1 + i % floors, (ParkingSpotType)(i % 2));
+    double countNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / reads;
+    start = chrono::steady_clock::now();
+    for (int i=0; i<reads; i++)
+        sink += parkingLot->canPark(i % 2 == 0 ? VehicleType::CAR : VehicleType::MotorBike);
+    double canParkNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / reads;
+    cout << "snapshot of " << floors << " floors " << snapshotNs << " ns, free spots of a floor " << countNs << " ns, canPark "
+        << canParkNs << " ns" << (sink == 0 ? " " : "") << endl;
+
+    cout << "readers\ttickets/s\tchanges read\tlapped polls" << endl;
+    for (int readers: {0, 4}) {
+        atomic<bool> isDone{false};
+        atomic<long long> changesRead{0}, lappedPolls{0};
+        vector<thread> pool;
+        for (int i=0; i<readers; i++) {
+            pool.push_back(thread([&]() {
+                OccupancyBoard::Subscription subscription = board.subscribe();
+                vector<OccupancyChange> changes;
+                for (long long polls=1; !isDone.load(memory_order_relaxed); polls++) {
+                    changes.clear();
+                    if (!subscription.poll(changes))
+                        lappedPolls++;
+                    changesRead += changes.size();
+                    if (polls % 1000 == 0)
+                        board.getSnapshot();
+                }
+            }));
+        }
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> gatePool;
+        for (int i=0; i<gates; i++) {
+            gatePool.push_back(thread([&, i]() {
+                EntrancePanel entrance(i + 1);
+                ExitPanel exitPanel(i + 1);
+                Vehicle car("KA01" + to_string(i), VehicleType::CAR);
+                deque<ParkingTicket*> held;
+                for (int j=0; j<iterations; j++) {
+                    held.push_back(entrance.getParkingTicket(&car));
+                    if (held.size() == 64) {
+                        exitPanel.scanAndVacate(held.front());
+                        held.pop_front();
+                    }
+                }
+                for (ParkingTicket *parkingTicket: held)
+                    exitPanel.scanAndVacate(parkingTicket);
+            }));
+        }
+        for (auto &gate: gatePool)
+            gate.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        isDone = true;
+        for (auto &reader: pool)
+            reader.join();
+
+        for (FloorOccupancy &floor: board.getSnapshot()) {
+            if (floor.floorId <= floors && (floor.occupiedCounts[ParkingSpotType::MEDIUM] != 0 || floor.spotCounts[ParkingSpotType::MEDIUM] != spotsPerFloor / 2))
+                cout << "every spot should be counted as free again once the gates are done" << endl;
+        }
+        cout << readers << "\t" << (long long)(gates * iterations / seconds) << "\t\t" << changesRead << "\t\t" << lappedPolls << endl;
+    }
+
+    board.clear();
+    parkingLot->setParkingStrategy(previousStrategy);
+}
+
+/* 1000 lots of 2 floors x 100 slots run by 1, 2 & 4 workers. Client threads send mixed traffic, half arrivals & half
+departures of random vehicles at random lots, keeping a window of requests in flight, while a reader asks about every
+millisecond for the lots with a free LARGE slot */
+void benchmarkRegistry()
+{
+    const int lots = 1000;
+    const int floors = 2;
+    const int requests = 2000000;
+    const int clients = 2;
+    const long long window = 4096;   // requests in flight per client
+
+    Vehicle vehicles[] = {Vehicle("KA01", VehicleType::CAR), Vehicle("KA02", VehicleType::MotorBike),
+        Vehicle("KA03", VehicleType::TRUCK), Vehicle("KA04", VehicleType::BUS)};
+    int vehicleWeights[] = {60, 20, 15, 5};
+
+    cout << "workers\trequests/s\trejected\tqueries\tus/query" << endl;
+    for (int workers: {1, 2, 4}) {
+        ParkingLotRegistry registry(workers);
+        vector<vector<ParkingTicket*>> parked(lots);   // by lot, touched by the worker of the lot only
+        for (int i=0; i<lots; i++) {
+            registry.addParkingLot([](ParkingLot &parkingLot) {
+                for (int floorId=1; floorId<=floors; floorId++) {
+                    parkingLot.addParkingFloor(new ParkingFloor(floorId));
+                    parkingLot.addParkingSpots(floorId, ParkingSpotType::SMALL, 20);
+                    parkingLot.addParkingSpots(floorId, ParkingSpotType::MEDIUM, 50);
+                    parkingLot.addParkingSpots(floorId, ParkingSpotType::LARGE, 20);
+                    parkingLot.addParkingSpots(floorId, ParkingSpotType::XLARGE, 10);
+                }
+                parkingLot.addEntryPanel(new EntrancePanel(&parkingLot, 1));
+                parkingLot.addExitPanel(new ExitPanel(&parkingLot, 1));
+            });
+        }
+        registry.drain();
+
+        struct alignas(64) Progress { atomic<long long> done{0}; };
+        Progress progress[clients];
+        atomic<long long> rejected{0};
+        atomic<bool> isDone{false};
+        long long queries = 0;
+        double querySeconds = 0;
+        thread reader([&]() {
+            while (!isDone.load(memory_order_relaxed)) {
+                auto start = chrono::steady_clock::now();
+                registry.findParkingLots(ParkingSpotType::LARGE);
+                querySeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                queries++;
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        });
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (int client=0; client<clients; client++) {
+            pool.push_back(thread([&, client]() {
+                mt19937 random(client);
+                atomic<long long> &done = progress[client].done;
+                for (long long sent=0; sent<requests/clients; sent++) {
+                    while (sent - done.load(memory_order_acquire) >= window)
+                        this_thread::yield();
+
+                    int lotId = random() % lots;
+                    uint32_t draw = random();
+                    int weight = draw % 100;
+                    Vehicle *vehicle = vehicles;
+                    for (int i=0; weight >= vehicleWeights[i]; weight -= vehicleWeights[i++])
+                        vehicle++;
+                    registry.submit(lotId, [&parked, &done, &rejected, lotId, draw, vehicle](ParkingLot &parkingLot) {
+                        vector<ParkingTicket*> &tickets = parked[lotId];
+                        if ((draw >> 8) % 2 == 0 || tickets.empty()) {
+                            ParkingTicket *parkingTicket = parkingLot.getEntryPanels()[0]->getParkingTicket(vehicle);
+                            if (parkingTicket == NULL)
+                                rejected.fetch_add(1, memory_order_relaxed);
+                            else
+                                tickets.push_back(parkingTicket);
+                        } else {
+                            size_t index = (draw >> 9) % tickets.size();
+                            swap(tickets[index], tickets.back());
+                            parkingLot.getExitPanels()[0]->scanAndVacate(tickets.back());
+                            tickets.pop_back();
+                        }
+                        done.fetch_add(1, memory_order_release);
+                    });
+                }
+                while (done.load(memory_order_acquire) < requests/clients)
+                    this_thread::yield();
+            }));
+        }
+        for (auto &client: pool)
+            client.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        isDone = true;
+        reader.join();
+
+        for (int lotId=0; lotId<lots; lotId++) {
+            registry.submit(lotId, [&parked, lotId](ParkingLot &parkingLot) {
+                vector<ParkingTicket> settledTickets;
+                parkingLot.getExitPanels()[0]->scanAndVacate(parked[lotId].data(), parked[lotId].size(), settledTickets);
+                parked[lotId].clear();
+            });
+        }
+        registry.drain();
+        if (registry.findParkingLots(ParkingSpotType::LARGE).size() != (size_t)lots)
+            cout << "every lot should have its LARGE slots free again" << endl;
+        cout << workers << "\t" << (long long)(requests / seconds) << "\t\t" << rejected << "\t\t" << queries << "\t"
+            << (queries == 0 ? 0 : querySeconds / queries * 1e6) << endl;
+    }
+}
+
+/* Runs a trace on the lot of getInstance() through 2 gates, with a fresh ConcurrentParkingStrategy of 20k slots on floors
+of 100, split over the spot types like the vehicle mix of the default traffic profile */
+TrafficReport runTrafficOnLot(const vector<TrafficEvent> &events, double speedup = 1)
+{
+    const int floors = 200;
+    const int gates = 2;
+
+    ParkingLot *parkingLot = ParkingLot::getInstance();
+    ParkingStrategy *previousStrategy = parkingLot->parkingStrategy;
+    for (int floorId=1; floorId<=floors; floorId++) {
+        if (parkingLot->getParkingFloor(floorId) == NULL)
+            parkingLot->addParkingFloor(new ParkingFloor(floorId));
+    }
+
+    ConcurrentParkingStrategy strategy(floors * 100);
+    parkingLot->setParkingStrategy(&strategy);
+    for (int floorId=1; floorId<=floors; floorId++) {
+        parkingLot->addParkingSpots(floorId, ParkingSpotType::SMALL, 20);
+        parkingLot->addParkingSpots(floorId, ParkingSpotType::MEDIUM, 60);
+        parkingLot->addParkingSpots(floorId, ParkingSpotType::LARGE, 15);
+        parkingLot->addParkingSpots(floorId, ParkingSpotType::XLARGE, 5);
+    }
+
+    TrafficReport report = runTraffic(parkingLot, events, gates, speedup);
+    parkingLot->getOccupancyBoard().clear();
+    parkingLot->setParkingStrategy(previousStrategy);
+    return report;
+}
+
+/* Open loop traffic of 200k vehicles at 50k, 100k & 200k arrivals/s, then a trace recorded to a file & replayed, which
+must give the same events */
+void benchmarkTraffic()
+{
+    const uint32_t vehicles = 200000;
+
+    TrafficProfile profile;
+    for (double arrivalsPerSecond: {50000, 100000, 200000}) {
+        profile.arrivalsPerSecond = arrivalsPerSecond;
+        cout << "arrivals/s " << arrivalsPerSecond << ", mean dwell " << profile.meanDwellSeconds << " s" << endl;
+        TrafficReport report = runTrafficOnLot(generateTraffic(profile, vehicles, 1));
+        printTrafficReport(report);
+    }
+
+    string path = (filesystem::temp_directory_path() / "parking-bench.trace").string();
+    vector<TrafficEvent> recorded = generateTraffic(TrafficProfile(), vehicles, 2);
+    writeTrace(path, recorded);
+    vector<TrafficEvent> replayed = readTrace(path);
+    filesystem::remove(path);
+    if (replayed.size() != recorded.size() || memcmp(replayed.data(), recorded.data(), recorded.size() * sizeof(TrafficEvent)) != 0)
+        cout << "a replayed trace should have the recorded events" << endl;
+    cout << "replay of " << path << endl;
+    TrafficReport report = runTrafficOnLot(replayed);
+    printTrafficReport(report);
+}
+
+/* 1M holds on a lot of 1.1M slots: the cost of a hold, of allotting & vacating slots with & without the holds outstanding,
+of claiming & cancelling holds and of expiring the rest over an hour of 1 second ticks. Then 1M timers on a bare timing
+wheel, spread over 2^20 ticks. */
+void benchmarkReservations()
+{
+    const int holds = 1000000;
+    const int spots = 1100000;
+    const int spotsPerFloor = 1000;
+    const int iterations = 1000000;
+    const int window = 1000;   // slots allotted at a time
+
+    ParkingLot *parkingLot = ParkingLot::getInstance();
+    ParkingStrategy *previousStrategy = parkingLot->parkingStrategy;
+    NormalParkingStrategy strategy;
+    for (int i=0; i<spots; i++)
+        strategy.addParkingSpot(1 + i / spotsPerFloor, ParkingSpotType::MEDIUM);
+    parkingLot->setParkingStrategy(&strategy);
+
+    auto timeAllotments = [&]() {
+        vector<ParkingSpot*> allotted(window, NULL);
+        auto start = chrono::steady_clock::now();
+        for (int i=0; i<iterations; i++) {
+            if (allotted[i % window] != NULL)
+                strategy.vacateParkingSpot(allotted[i % window]);
+            allotted[i % window] = strategy.getParkingSpot(ParkingSpotType::MEDIUM);
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+        for (ParkingSpot *parkingSpot: allotted)
+            strategy.vacateParkingSpot(parkingSpot);
+        return ns;
+    };
+    double allotNs = timeAllotments();
+
+    mt19937 random(1);
+    ReservationBook book(parkingLot, 0);
+    vector<int64_t> reservationIds(holds);
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<holds; i++)
+        reservationIds[i] = book.reserve(ParkingSpotType::MEDIUM, 60 + random() % 3540, 0);
+    double reserveNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / holds;
+    double heldAllotNs = timeAllotments();
+
+    shuffle(reservationIds.begin(), reservationIds.end(), random);
+    EntrancePanel entrance(parkingLot, 1);
+    ExitPanel exitPanel(parkingLot, 1);
+    Vehicle car("KA01", VehicleType::CAR);
+    vector<ParkingTicket*> parked;
+    start = chrono::steady_clock::now();
+    for (int i=0; i<holds/10; i++)
+        parked.push_back(entrance.getParkingTicket(&car, book, reservationIds[i]));
+    double claimNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (holds / 10);
+    start = chrono::steady_clock::now();
+    for (int i=holds/10; i<holds/5; i++)
+        book.cancel(reservationIds[i]);
+    double cancelNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (holds / 10);
+    if (book.claim(reservationIds[0], ParkingSpotType::MEDIUM) != NULL || book.cancel(reservationIds[holds / 10]))
+        cout << "a hold should only be claimed or cancelled once" << endl;
+
+    size_t expired = 0;
+    start = chrono::steady_clock::now();
+    for (time_t now=1; now<=3600; now++)
+        expired += book.expireHolds(now);
+    double expireMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (expired != (size_t)(holds - holds / 5) || book.getHoldCount() != 0)
+        cout << "every hold left should expire within the hour" << endl;
+    vector<ParkingTicket> settledTickets;
+    exitPanel.scanAndVacate(parked.data(), parked.size(), settledTickets);
+
+    cout << "ns/allotment without holds " << allotNs << ", with " << holds << " holds " << heldAllotNs << endl;
+    cout << "ns/hold " << reserveNs << ", ns/claim " << claimNs << ", ns/cancel " << cancelNs << ", " << expired
+        << " holds expired over 3600 ticks in " << expireMs << " ms" << endl;
+
+    TimingWheel wheel;
+    const uint64_t ticks = 1 << 20;
+    vector<uint64_t> timerIds(holds);
+    start = chrono::steady_clock::now();
+    for (int i=0; i<holds; i++)
+        timerIds[i] = wheel.schedule(1 + random() % ticks, i);
+    double scheduleNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / holds;
+    start = chrono::steady_clock::now();
+    uint64_t payload;
+    for (int i=0; i<holds; i+=2)
+        wheel.cancel(timerIds[i], payload);
+    double wheelCancelNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (holds / 2);
+    start = chrono::steady_clock::now();
+    size_t fired = wheel.advance(ticks, [](uint64_t) {});
+    double tickNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ticks;
+    if (fired != (size_t)holds / 2)
+        cout << "every timer not cancelled should fire" << endl;
+    cout << "timing wheel: ns/schedule " << scheduleNs << ", ns/cancel " << wheelCancelNs << ", ns/tick " << tickNs
+        << " (" << fired << " fired over " << ticks << " ticks)" << endl;
+
+    parkingLot->getOccupancyBoard().clear();
+    parkingLot->setParkingStrategy(previousStrategy);
+}
+
+void printUsage(const char *program)
+{
+    cerr << "usage: " << program << " [--bench | --strategy <normal|nearest|concurrent> | --record <trace> [vehicles]"
+        << " | --replay <trace> [speedup]]" << endl;
+}
+
+/* Driver function, pass --bench to run the benchmarks instead of the demo, --strategy <normal|nearest|concurrent> to run
+the demo with another parking strategy, --record <trace> [vehicles] to generate traffic, save it & run it,
+--replay <trace> [speedup] to run a saved trace again */
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        benchmarkAllocator();
+
+        benchmarkNearest();
+
+        benchmarkGates();
+
+        benchmarkExits();
+
+        soakTest();
+
+        benchmarkIdGenerator();
+
+        benchmarkJournal();
+
+        benchmarkOccupancy();
+
+        benchmarkRegistry();
+
+        benchmarkTraffic();
+
+        benchmarkReservations();
+        return 0;
+    }
+
+    if (argc > 2 && (string(argv[1]) == "--record" || string(argv[1]) == "--replay")) {
+        try {
+            vector<TrafficEvent> events;
+            double speedup = 1;
+            char *end = NULL;
+            errno = 0;
+            if (string(argv[1]) == "--record") {
+                unsigned long vehicles = argc > 3 ? strtoul(argv[3], &end, 10) : 200000;
+                if (argc > 3 && (*end != '\0' || !isdigit(argv[3][0]) || errno != 0 || vehicles == 0 || vehicles > UINT32_MAX))
+                    throw invalid_argument(string("invalid number of vehicles ") + argv[3]);
+                events = generateTraffic(TrafficProfile(), vehicles, time(NULL));
+                writeTrace(argv[2], events);
+            } else {
+                speedup = argc > 3 ? strtod(argv[3], &end) : 1;
+                if (argc > 3 && (*end != '\0' || end == argv[3] || !(speedup > 0) || !isfinite(speedup)))
+                    throw invalid_argument(string("invalid speedup ") + argv[3]);
+                events = readTrace(argv[2]);
+            }
+            TrafficReport report = runTrafficOnLot(events, speedup);
+            printTrafficReport(report);
+        } catch (const invalid_argument &e) {
+            cerr << e.what() << endl;
+            printUsage(argv[0]);
+            return 1;
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    ParkingLot* parkingLot = ParkingLot::getInstance();
+    if (argc > 2 && string(argv[1]) == "--strategy") {
+        try {
+            parkingLot->setParkingStrategy(ParkingStrategyFactory::createParkingStrategy(argv[2]));
+        } catch (const invalid_argument &e) {
+            cerr << e.what() << endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    parkingLot->setAddress("Parking Lot, Phoenix Mall, Bengaluru, Karnataka");
 
     // should be able to add a parking floor
     parkingLot->addParkingFloor(new ParkingFloor(1));
@@ -401,67 +3893,67 @@ int main()
 
     int floorId = 1;
     // should be able to add parking spot of different types
-    parkingLot->parkingStrategy.addParkingSpot(floorId, ParkingSpotType::SMALL);
-    parkingLot->parkingStrategy.addParkingSpot(floorId, ParkingSpotType::LARGE);
-    parkingLot->parkingStrategy.addParkingSpot(floorId, ParkingSpotType::MEDIUM);
+    parkingLot->addParkingSpots(floorId, ParkingSpotType::SMALL);
+    parkingLot->addParkingSpots(floorId, ParkingSpotType::LARGE);
+    parkingLot->addParkingSpots(floorId, ParkingSpotType::MEDIUM);
 
     // check for availability of parking lot - TRUE
     cout << ParkingLot::getInstance()->canPark(VehicleType::CAR) << endl;
     // check for availability of parking lot - FALSE
     cout << ParkingLot::getInstance()->canPark(VehicleType::VAN) << endl;
 
-    Vehicle *vehicle = new Vehicle("KA05MR2311", VehicleType::CAR);
-    Vehicle *van = new Vehicle("KA01MR7804", VehicleType::VAN);
+    Vehicle *vehicle = VehicleFactory::createVehicle("KA05MR2311", VehicleType::CAR);
+    Vehicle *van = VehicleFactory::createVehicle("KA01MR7804", VehicleType::VAN);
     
     // Should be able to get parking ticket
     ParkingTicket *parkingTicket = entrance->getParkingTicket(vehicle);
     cout << parkingTicket->getAllocatedSpot()->getSpotId() << endl;
 
-    parkingLot->parkingStrategy.addParkingSpot(floorId, ParkingSpotType::MEDIUM);
+    parkingLot->addParkingSpots(floorId, ParkingSpotType::MEDIUM);
 
     // Should be able to get parking ticket
-    Vehicle *car = new Vehicle("KA02MR6355", VehicleType::CAR);
+    Vehicle *car = VehicleFactory::createVehicle("KA02MR6355", VehicleType::CAR);
     ParkingTicket *parkingTicket1 = entrance->getParkingTicket(car);
     cout << parkingTicket1->getAllocatedSpot()->getSpotId() << endl;
 
     // Should not be able to get ticket
-    ParkingTicket *tkt = entrance->getParkingTicket(new Vehicle("ka04rb8458", VehicleType::CAR));
+    ParkingTicket *tkt = entrance->getParkingTicket(VehicleFactory::createVehicle("ka04rb8458", VehicleType::CAR));
     cout << "Parking Ticket should be NULL and the assertion is " << (NULL == tkt) << endl;
 
     // Should be able to get ticket
-    ParkingTicket *mtrTkt = entrance->getParkingTicket(new Vehicle("ka01ee4901", VehicleType::MotorBike));
+    ParkingTicket *mtrTkt = entrance->getParkingTicket(VehicleFactory::createVehicle("ka01ee4901", VehicleType::MotorBike));
     cout << mtrTkt->getAllocatedSpot()->getSpotId() << endl;
 
-    // vacate parking spot
-    mtrTkt = exitPanel->scanAndVacate(mtrTkt);
-    cout << mtrTkt->getCharges() << endl;
+    // vacate parking spot, the scanned ticket is recycled
+    ParkingTicket mtrReceipt = exitPanel->scanAndVacate(mtrTkt);
+    cout << mtrReceipt.getCharges() << endl;
 
     // park on vacated spot
-    ParkingTicket *mtrTkt1 = entrance->getParkingTicket(new Vehicle("ka01ee7791", VehicleType::MotorBike));
-    cout << mtrTkt->getAllocatedSpot()->getSpotId() << endl;
+    ParkingTicket *mtrTkt1 = entrance->getParkingTicket(VehicleFactory::createVehicle("ka01ee7791", VehicleType::MotorBike));
+    cout << mtrTkt1->getAllocatedSpot()->getSpotId() << endl;
 
     // park when spot is not available
-    ParkingTicket *unavailableTkt = entrance->getParkingTicket(new Vehicle("ka01ee4455", VehicleType::MotorBike));
+    ParkingTicket *unavailableTkt = entrance->getParkingTicket(VehicleFactory::createVehicle("ka01ee4455", VehicleType::MotorBike));
     cout << "Parking Ticket should be NULL and the assertion is " << (NULL == unavailableTkt) << endl;
 
     // vacate car
-    parkingTicket = exitPanel->scanAndVacate(parkingTicket);
-    cout << parkingTicket->getCharges() << endl;
+    ParkingTicket receipt = exitPanel->scanAndVacate(parkingTicket);
+    cout << receipt.getCharges() << endl;
 
     // Now should be able to park car
     cout << ParkingLot::getInstance()->canPark(VehicleType::CAR) << endl;
 
     // Should be able to vacate parked vehicle
-    parkingTicket1 = exitPanel->scanAndVacate(parkingTicket1);
-    cout << parkingTicket1->getCharges() << endl;
+    ParkingTicket receipt1 = exitPanel->scanAndVacate(parkingTicket1);
+    cout << receipt1.getCharges() << endl;
 
     // Payment
-    Payment payment(time(NULL), parkingTicket1->getTicketNumber(), parkingTicket1->getCharges());
+    Payment payment(IdGenerator::getInstance().nextId(), receipt1.getTicketNumber(), receipt1.getCharges());
     payment.makePayment();
 
     // vacate motorbike spot
-    mtrTkt = exitPanel->scanAndVacate(mtrTkt);
-    cout << mtrTkt->getCharges() << endl;
+    mtrReceipt = exitPanel->scanAndVacate(mtrTkt1);
+    cout << mtrReceipt.getCharges() << endl;
 
     return 0;
 }
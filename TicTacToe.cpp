@@ -1,19 +1,31 @@
 #include <bits/stdc++.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "AllocationCounter.h"
 using namespace std;
 
 /* =========================================================== */
 /* ==================== Tic Tac Toe Design =================== */
 /* =========================================================== */
 
-/* In general, we have two piece types but this can be extended to support multiple piece types */
+/* In general, we have two piece types, D & H let up to four players share a board */
 enum PlayingPieceType
 {
     PieceTypeX,
-    PieceTypeO
-    // PieceTypeD
-    // PieceTypeH
+    PieceTypeO,
+    PieceTypeD,
+    PieceTypeH
 };
 
+const int PIECE_TYPE_COUNT = 4;
+
 /* Players can choose from different types of playing piece at the start of the game */
 class PlayingPiece
 {
@@ -53,108 +65,764 @@ public:
     }
 };
 
+/* PieceD extends Playing Piece to represent a piece type */
+class PlayingPieceD: public PlayingPiece
+{
+public:
+    PlayingPieceD(): PlayingPiece(PlayingPieceType::PieceTypeD) {
+
+    }
+
+    char getPieceSign() {
+        return 'D';
+    }
+};
+
+/* PieceH extends Playing Piece to represent a piece type */
+class PlayingPieceH: public PlayingPiece
+{
+public:
+    PlayingPieceH(): PlayingPiece(PlayingPieceType::PieceTypeH) {
+
+    }
+
+    char getPieceSign() {
+        return 'H';
+    }
+};
+
+PlayingPiece* createPlayingPiece(PlayingPieceType pieceType)
+{
+    switch (pieceType)
+    {
+        case PieceTypeX: return new PlayingPieceX();
+        case PieceTypeO: return new PlayingPieceO();
+        case PieceTypeD: return new PlayingPieceD();
+        case PieceTypeH: return new PlayingPieceH();
+    }
+    throw invalid_argument("unknown piece type");
+}
+
 /* Player is one of the main entity and has a playing piece assigned at the start of the game */
 class Player
 {
 public:
     string name;
     PlayingPiece* playingPiece;
+    bool isComputer;
 
-    Player(string name, PlayingPiece* playingPiece) {
+    Player(string name, PlayingPiece* playingPiece, bool isComputer = false) {
         this->name = name;
         this->playingPiece = playingPiece;
+        this->isComputer = isComputer;
     }
 };
 
-/* GameBoard represents the playing board and at each position it keeps the Piece information placed on that position */
+/* State of a single row / column / diagonal, a line is won once it has size pieces of a single owner */
+struct LineState
+{
+    int count = 0;
+    uint8_t owner = 0;
+    bool isMixed = false;
+
+    void addPiece(uint8_t piece) {
+        if (owner == 0)
+            owner = piece;
+        else if (owner != piece)
+            isMixed = true;
+        count++;
+    }
+
+    bool isCompletedBy(uint8_t piece, int size) {
+        return count == size && !isMixed && owner == piece;
+    }
+};
+
+/* GameBoard represents the playing board, a player wins by placing winLength of its pieces in a row, column or
+diagonal (by default the full size of the board as in classic tic tac toe). The cells are one contiguous array holding
+the piece id of every cell, EMPTY or the piece type + 1, so even a 1000x1000 board is a single 1MB block.
+After a move only the 2*winLength-1 cells around it in each of the four directions are scanned. When winLength is the
+size of the board the running counters of every row, column & both diagonals answer in O(1) instead. */
 class GameBoard
 {
 public:
+    static constexpr uint8_t EMPTY = 0;
+
     int size;
-    vector<vector<PlayingPiece*>> board;
+    int winLength;
+    vector<uint8_t> cells;
+    PlayingPiece* pieces[PIECE_TYPE_COUNT + 1] = {};   // piece placed for every id, used to print the board
+    vector<LineState> rows;
+    vector<LineState> cols;
+    LineState diagonal;
+    LineState antiDiagonal;
+    int filledCells = 0;
 
-    GameBoard(int size) {
+    GameBoard(int size, int winLength = 0) {
         this->size = size;
-        this->board.resize(size, vector<PlayingPiece*>(size));
+        this->winLength = winLength > 0 ? min(winLength, size) : size;
+        this->cells.resize((size_t)size * size, EMPTY);
+        if (this->winLength == size) {
+            this->rows.resize(size);
+            this->cols.resize(size);
+        }
+    }
+
+    static uint8_t getPieceId(PlayingPieceType pieceType) {
+        return pieceType + 1;
+    }
+
+    uint8_t getCell(int r, int c) {
+        return cells[(size_t)r * size + c];
+    }
+
+    bool isEmpty(int r, int c) {
+        return getCell(r, c) == EMPTY;
     }
 
     /* Given a row & col and player piece, it marks the current player move on the board if applicable otherwise returns false */
     bool makeMove(int r, int c, PlayingPiece* piece)
     {
-        if (board[r][c] != NULL)
+        if (r < 0 || r >= size || c < 0 || c >= size || !isEmpty(r, c))
             return false;
-        
-        board[r][c] = piece;
+
+        uint8_t id = getPieceId(piece->pieceType);
+        cells[(size_t)r * size + c] = id;
+        pieces[id] = piece;
+        if (winLength == size) {
+            rows[r].addPiece(id);
+            cols[c].addPiece(id);
+            if (r == c)
+                diagonal.addPiece(id);
+            if (r + c == size - 1)
+                antiDiagonal.addPiece(id);
+        }
+        filledCells++;
         return true;
     }
 
-    /* Checks if there are any moves left to be made. If the board gets full and no winner yet, it's a tie. */
-    bool checkMoveAvailable()
+    /* Empties the board for a new game, keeps the cells & counters so that no memory is allocated */
+    void reset()
     {
-        for (auto row: board) {
-            for (auto cell: row) {
-                if (cell == NULL)
-                    return true;
-            }
+        fill(cells.begin(), cells.end(), EMPTY);
+        fill(rows.begin(), rows.end(), LineState());
+        fill(cols.begin(), cols.end(), LineState());
+        diagonal = antiDiagonal = LineState();
+        filledCells = 0;
+    }
+
+    /* Number of cells next to (r,c) in the direction (dr,dc) holding id, at most winLength - 1 */
+    int countInDirection(int r, int c, int dr, int dc, uint8_t id)
+    {
+        int count = 0;
+        for (r += dr, c += dc; count < winLength - 1 && r >= 0 && r < size && c >= 0 && c < size && getCell(r, c) == id; r += dr, c += dc)
+            count++;
+        return count;
+    }
+
+    /* True if a piece with id at (r,c) makes winLength in a row, the cell (r,c) itself is not read */
+    bool completesLine(int r, int c, uint8_t id)
+    {
+        static const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        for (auto &direction: directions) {
+            int dr = direction[0], dc = direction[1];
+            if (1 + countInDirection(r, c, dr, dc, id) + countInDirection(r, c, -dr, -dc, id) >= winLength)
+                return true;
         }
         return false;
     }
 
+    /* True if placing pieceType at the empty cell (r,c) would win, without making the move */
+    bool isWinningMove(int r, int c, PlayingPieceType pieceType)
+    {
+        uint8_t id = getPieceId(pieceType);
+        if (winLength != size)
+            return completesLine(r, c, id);
+        return rows[r].isCompletedBy(id, size - 1) || cols[c].isCompletedBy(id, size - 1)
+            || (r == c && diagonal.isCompletedBy(id, size - 1))
+            || (r + c == size - 1 && antiDiagonal.isCompletedBy(id, size - 1));
+    }
+
+    /* Checks if there are any moves left to be made. If the board gets full and no winner yet, it's a tie. */
+    bool checkMoveAvailable()
+    {
+        return filledCells < size * size;
+    }
+
     /* On the basis of last player's move decide if the game is complete or not by following the rules. */
     bool checkWinner(int r, int c, PlayingPiece* piece)
     {
-        bool isRowComplete = true;
-        bool isColComplete = true;
-        bool isDiagonalComplete = true;
-        bool isAntiDiagonalComplete = true;
-        
-        // check row
-        for (int i=0; i<size; i++) {
-            if (board[r][i] != piece) {
-                isRowComplete = false;
-                break;
+        uint8_t id = getPieceId(piece->pieceType);
+        if (winLength != size)
+            return completesLine(r, c, id);
+        return rows[r].isCompletedBy(id, size) || cols[c].isCompletedBy(id, size)
+            || diagonal.isCompletedBy(id, size) || antiDiagonal.isCompletedBy(id, size);
+    }
+
+    /* Prints the current board layout before each player's move */
+    void printToConsole() {
+        cout << "Board Layout" << endl;
+        for (int r=0; r<size; r++) {
+            for (int c=0; c<size; c++) {
+                if (!isEmpty(r, c)) {
+                    cout << pieces[getCell(r, c)]->getPieceSign();
+                }
+                cout << "\t" << "|";
             }
+            cout << endl;
         }
+    }
+};
 
-        // check col
-        for (int i=0; i<size; i++) {
-            if (board[i][c] != piece) {
-                isColComplete = false;
-                break;
+/* =========================================================== */
+/* ========================= Bit Board ======================= */
+/* =========================================================== */
+
+/* Compact board for search & simulation of classic two player games (X & O, the line spans the whole board): one
+bitset per piece type where bit r*Size+c is set if the piece occupies (r,c). Win check is an AND / compare of the piece's bits against precomputed masks of the lines through the move.
+Bits is the smallest unsigned integer which can hold Size*Size bits for boards up to 8x8 (a 3x3 position takes 4 bytes)
+and a std::bitset for larger boards, see the BitBoard alias below. */
+template <int Size, typename Bits>
+class BasicBitBoard
+{
+public:
+    static const int PLAYERS = 2;
+
+    struct LineMasks {
+        Bits rows[Size];
+        Bits cols[Size];
+        Bits diagonal;
+        Bits antiDiagonal;
+        Bits full;
+
+        LineMasks() {
+            diagonal = antiDiagonal = full = Bits();
+            for (int i=0; i<Size; i++) {
+                rows[i] = cols[i] = Bits();
+                for (int j=0; j<Size; j++) {
+                    rows[i] |= getBit(i, j);
+                    cols[i] |= getBit(j, i);
+                }
+                diagonal |= getBit(i, i);
+                antiDiagonal |= getBit(i, Size - 1 - i);
             }
+            for (int i=0; i<Size*Size; i++)
+                full |= getBit(i / Size, i % Size);
         }
+    };
 
-        // check diagonal
-        for (int i=0, j=0; i<size; i++, j++) {
-            if (board[i][j] != piece) {
-                isDiagonalComplete = false;
-                break;
+    static const LineMasks& getMasks() {
+        static const LineMasks masks;
+        return masks;
+    }
+
+private:
+    static bool isLineComplete(const Bits &pieces, const Bits &mask) {
+        return (pieces & mask) == mask;
+    }
+
+    Bits pieces[PLAYERS] = {};
+
+public:
+    static Bits getBit(int r, int c) {
+        Bits bit = Bits();
+        if constexpr (is_integral_v<Bits>)
+            bit = (Bits)((Bits)1 << (r * Size + c));
+        else
+            bit.set(r * Size + c);
+        return bit;
+    }
+
+    static BasicBitBoard fromGameBoard(GameBoard &board) {
+        if (board.size != Size)
+            throw invalid_argument("bit board of size " + to_string(Size) + " can't hold a board of size " + to_string(board.size));
+        if (board.winLength != board.size)
+            throw invalid_argument("bit board only supports lines spanning the whole board");
+
+        BasicBitBoard bitBoard;
+        for (int r=0; r<Size; r++) {
+            for (int c=0; c<Size; c++) {
+                if (board.isEmpty(r, c))
+                    continue;
+                if (board.getCell(r, c) > PLAYERS)
+                    throw invalid_argument("bit board only supports two players");
+                bitBoard.makeMove(r, c, (PlayingPieceType)(board.getCell(r, c) - 1));
             }
         }
+        return bitBoard;
+    }
 
-        // check anti diagonal
-        for (int i=0, j=size-1; i<size; i++, j--) {
-            if (board[i][j] != piece) {
-                isAntiDiagonalComplete = false;
-                break;
+    bool isEmpty(int r, int c) {
+        return (getOccupied() & getBit(r, c)) == Bits();
+    }
+
+    bool makeMove(int r, int c, PlayingPieceType pieceType) {
+        if (r < 0 || r >= Size || c < 0 || c >= Size || !isEmpty(r, c))
+            return false;
+
+        pieces[pieceType] |= getBit(r, c);
+        return true;
+    }
+
+    void undoMove(int r, int c, PlayingPieceType pieceType) {
+        pieces[pieceType] &= ~getBit(r, c);
+    }
+
+    bool checkMoveAvailable() {
+        return getOccupied() != getMasks().full;
+    }
+
+    bool checkWinner(int r, int c, PlayingPieceType pieceType) {
+        const LineMasks &masks = getMasks();
+        const Bits &own = pieces[pieceType];
+        return isLineComplete(own, masks.rows[r]) || isLineComplete(own, masks.cols[c])
+            || (r == c && isLineComplete(own, masks.diagonal))
+            || (r + c == Size - 1 && isLineComplete(own, masks.antiDiagonal));
+    }
+
+    Bits getPieces(PlayingPieceType pieceType) const {
+        return pieces[pieceType];
+    }
+
+    Bits getOccupied() const {
+        Bits occupied = Bits();
+        for (int i=0; i<PLAYERS; i++)
+            occupied |= pieces[i];
+        return occupied;
+    }
+
+    bool operator==(const BasicBitBoard &other) const {
+        for (int i=0; i<PLAYERS; i++) {
+            if (pieces[i] != other.pieces[i])
+                return false;
+        }
+        return true;
+    }
+};
+
+template <int Size>
+using BitBoard = BasicBitBoard<Size,
+    conditional_t<Size * Size <= 16, uint16_t,
+    conditional_t<Size * Size <= 32, uint32_t,
+    conditional_t<Size * Size <= 64, uint64_t, bitset<Size * Size>>>>>;
+
+/* =========================================================== */
+/* ======================== Game Solver ====================== */
+/* =========================================================== */
+
+/* Random keys used to hash a position incrementally: the hash of a position is the XOR of the keys of every
+(piece type, cell) on the board and of the side to move, so a move updates the hash with a single XOR */
+struct ZobristKeys
+{
+    static const int MAX_CELLS = 64;
+
+    uint64_t cells[PIECE_TYPE_COUNT][MAX_CELLS];
+    uint64_t sideToMove[PIECE_TYPE_COUNT];
+
+    ZobristKeys() {
+        mt19937_64 rng(0x5eed);
+        for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+            for (int j=0; j<MAX_CELLS; j++)
+                cells[i][j] = rng();
+            sideToMove[i] = rng();
+        }
+    }
+
+    static const ZobristKeys& getInstance() {
+        static const ZobristKeys keys;
+        return keys;
+    }
+};
+
+/* Positions already searched, shared by all the search threads without a lock. Every entry is two words, the
+payload and the key XORed with the payload, so an entry torn by two threads writing at once fails the key check
+and is simply treated as a miss. */
+class TranspositionTable
+{
+public:
+    enum Bound { EXACT, LOWER, UPPER };
+
+    struct Probe {
+        int score;
+        int depth;
+        Bound bound;
+        int move;
+    };
+
+private:
+    struct Entry {
+        atomic<uint64_t> check{0};
+        atomic<uint64_t> data{0};
+    };
+
+    unique_ptr<Entry[]> entries;
+    size_t mask;
+
+public:
+    TranspositionTable(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        this->entries.reset(new Entry[size]);
+        this->mask = size - 1;
+    }
+
+    void store(uint64_t key, int score, int depth, Bound bound, int move) {
+        uint64_t data = (uint64_t)(uint16_t)score | (uint64_t)(uint8_t)depth << 16 | (uint64_t)bound << 24
+            | (uint64_t)(uint8_t)move << 32 | 1ULL << 40;
+        Entry &entry = entries[key & mask];
+        entry.check.store(key ^ data, memory_order_relaxed);
+        entry.data.store(data, memory_order_relaxed);
+    }
+
+    bool probe(uint64_t key, Probe &probe) {
+        Entry &entry = entries[key & mask];
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        if (data == 0 || (entry.check.load(memory_order_relaxed) ^ data) != key)
+            return false;
+
+        probe.score = (int16_t)(data & 0xFFFF);
+        probe.depth = (data >> 16) & 0xFF;
+        probe.bound = (Bound)((data >> 24) & 0x3);
+        probe.move = (data >> 32) & 0xFF;
+        return true;
+    }
+
+    void clear() {
+        for (size_t i=0; i<=mask; i++) {
+            entries[i].check.store(0, memory_order_relaxed);
+            entries[i].data.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+struct SolverResult
+{
+    int row = -1;
+    int col = -1;
+    int score = 0;          // from the point of view of the player to move, positive is winning
+    int depth = 0;          // depth of the last completed iteration
+    bool isSolved = false;  // true if the score is exact, i.e. the search reached the end of the game
+    long long nodes = 0;
+    double seconds = 0;
+};
+
+/* Negamax search with alpha-beta pruning over a bit board, one instance per search thread */
+template <int Size>
+class AlphaBetaSearch
+{
+public:
+    static const int WIN_SCORE = 10000;
+    static const int INFINITE_SCORE = 30000;
+
+    using Board = BitBoard<Size>;
+
+    long long nodes = 0;
+    bool isAborted = false;
+
+private:
+    TranspositionTable &table;
+    atomic<bool> &stop;
+    chrono::steady_clock::time_point deadline;
+    long long nodeLimit;
+
+    static PlayingPieceType getOpponent(PlayingPieceType pieceType) {
+        return pieceType == PlayingPieceType::PieceTypeX ? PlayingPieceType::PieceTypeO : PlayingPieceType::PieceTypeX;
+    }
+
+    static int scoreLine(uint64_t own, uint64_t opponent, uint64_t mask) {
+        int mine = __builtin_popcountll(own & mask);
+        int theirs = __builtin_popcountll(opponent & mask);
+        if (theirs == 0)
+            return mine * mine;
+        if (mine == 0)
+            return -theirs * theirs;
+        return 0;
+    }
+
+public:
+    AlphaBetaSearch(TranspositionTable &table, atomic<bool> &stop, chrono::steady_clock::time_point deadline, long long nodeLimit): table(table), stop(stop) {
+        this->deadline = deadline;
+        this->nodeLimit = nodeLimit;
+    }
+
+    /* Heuristic score of a position which is not over yet: lines still open for one side only, weighted by
+    the number of pieces that side already has on them */
+    static int evaluate(Board &board, PlayingPieceType pieceType) {
+        const typename Board::LineMasks &masks = Board::getMasks();
+        uint64_t own = board.getPieces(pieceType);
+        uint64_t opponent = board.getPieces(getOpponent(pieceType));
+
+        int score = scoreLine(own, opponent, masks.diagonal) + scoreLine(own, opponent, masks.antiDiagonal);
+        for (int i=0; i<Size; i++)
+            score += scoreLine(own, opponent, masks.rows[i]) + scoreLine(own, opponent, masks.cols[i]);
+        return score;
+    }
+
+    /* Score of the position after pieceType plays cell, from the point of view of pieceType */
+    int scoreMove(Board &board, PlayingPieceType pieceType, uint64_t hash, int cell, int depth, int alpha, int beta, int ply) {
+        const ZobristKeys &keys = ZobristKeys::getInstance();
+        int r = cell / Size, c = cell % Size;
+
+        int score;
+        board.makeMove(r, c, pieceType);
+        if (board.checkWinner(r, c, pieceType))
+            score = WIN_SCORE - ply - 1;
+        else if (!board.checkMoveAvailable())
+            score = 0;
+        else if (depth <= 1)
+            score = evaluate(board, pieceType);
+        else
+            score = -negamax(board, getOpponent(pieceType), hash ^ keys.cells[pieceType][cell] ^ keys.sideToMove[pieceType]
+                ^ keys.sideToMove[getOpponent(pieceType)], depth - 1, -beta, -alpha, ply + 1);
+        board.undoMove(r, c, pieceType);
+        return score;
+    }
+
+    int negamax(Board &board, PlayingPieceType pieceType, uint64_t hash, int depth, int alpha, int beta, int ply) {
+        if (++nodes > nodeLimit || ((nodes & 4095) == 0 && (stop.load(memory_order_relaxed) || chrono::steady_clock::now() > deadline))) {
+            stop.store(true, memory_order_relaxed);
+            isAborted = true;
+        }
+        if (isAborted)
+            return 0;
+
+        // win scores are stored relative to this position so that they stay valid wherever the position is reached
+        int alphaOriginal = alpha;
+        int ttMove = -1;
+        TranspositionTable::Probe probe;
+        if (table.probe(hash, probe)) {
+            ttMove = probe.move;
+            int score = probe.score;
+            if (score > WIN_SCORE - 100)
+                score -= ply;
+            else if (score < -WIN_SCORE + 100)
+                score += ply;
+
+            if (probe.depth >= depth) {
+                if (probe.bound == TranspositionTable::EXACT)
+                    return score;
+                if (probe.bound == TranspositionTable::LOWER)
+                    alpha = max(alpha, score);
+                else
+                    beta = min(beta, score);
+                if (alpha >= beta)
+                    return score;
+            }
+        }
+
+        int moves[Size * Size];
+        int moveCount = 0;
+        uint64_t occupied = board.getOccupied();
+        if (ttMove >= 0 && ttMove < Size * Size && !(occupied >> ttMove & 1))
+            moves[moveCount++] = ttMove;
+        for (int cell=0; cell<Size*Size; cell++) {
+            if (!(occupied >> cell & 1) && cell != ttMove)
+                moves[moveCount++] = cell;
+        }
+
+        int best = -INFINITE_SCORE, bestMove = moves[0];
+        for (int i=0; i<moveCount; i++) {
+            int score = scoreMove(board, pieceType, hash, moves[i], depth, alpha, beta, ply);
+            if (score > best) {
+                best = score;
+                bestMove = moves[i];
             }
+            alpha = max(alpha, score);
+            if (alpha >= beta)
+                break;
         }
 
-        return isRowComplete || isColComplete || isAntiDiagonalComplete || isDiagonalComplete;
+        if (isAborted)
+            return 0;
+
+        int stored = best;
+        if (stored > WIN_SCORE - 100)
+            stored += ply;
+        else if (stored < -WIN_SCORE + 100)
+            stored -= ply;
+        TranspositionTable::Bound bound = best <= alphaOriginal ? TranspositionTable::UPPER
+            : (best >= beta ? TranspositionTable::LOWER : TranspositionTable::EXACT);
+        table.store(hash, stored, depth, bound, bestMove);
+        return best;
     }
+};
 
-    /* Prints the current board layout before each player's move */
-    void printToConsole() {
-        cout << "Board Layout" << endl;
-        for (auto row: board) {
-            for (auto cell: row) {
-                if (cell != NULL) {
-                    cout << cell->getPieceSign();
+/* Engine which computes the best move for the current GameBoard. It runs iterative deepening alpha-beta with a time
+budget and optionally a limit on the nodes every search thread may visit, the transposition table is shared by all the threads and the root moves are split between the threads which
+steal from each other once they run out of their own. Two players on boards of up to 8x8 with lines spanning
+the whole board are supported.
+A solver searches one position at a time, use one instance per thread to search several in parallel. */
+class GameSolver
+{
+    int threads;
+    TranspositionTable table;
+    vector<int> rootMoves;  // kept between searches so that a warmed up solver does not allocate
+
+    template <int Size>
+    SolverResult searchRoot(BitBoard<Size> &board, PlayingPieceType pieceType, uint64_t hash, int depth,
+            chrono::steady_clock::time_point deadline, long long nodeLimit, bool &isAborted) {
+        using Search = AlphaBetaSearch<Size>;
+
+        // each thread owns a queue of root moves, a thread which runs out of work steals from the back of another.
+        // A single thread walks the moves in order without any queue so that it does not allocate.
+        int workers = max(1, min(threads, (int)rootMoves.size()));
+        vector<deque<int>> queues(workers > 1 ? workers : 0);
+        vector<mutex> queueMutexes(workers > 1 ? workers : 0);
+        for (size_t i=0; workers > 1 && i<rootMoves.size(); i++)
+            queues[i % workers].push_back(i);
+        size_t nextIndex = 0;
+
+        atomic<bool> stop{false};
+        atomic<int> sharedAlpha{-Search::INFINITE_SCORE};
+        mutex bestMutex;
+        int bestScore = -Search::INFINITE_SCORE, bestIndex = -1;
+        atomic<long long> nodes{0};
+        atomic<bool> aborted{false};
+
+        auto work = [&](int worker) {
+            Search search(table, stop, deadline, nodeLimit);
+            BitBoard<Size> localBoard = board;
+            while (true)
+            {
+                int index = -1;
+                if (workers == 1 && nextIndex < rootMoves.size())
+                    index = nextIndex++;
+                for (int i=0; workers > 1 && i<workers && index < 0; i++) {
+                    int victim = (worker + i) % workers;
+                    lock_guard<mutex> lock(queueMutexes[victim]);
+                    if (queues[victim].empty())
+                        continue;
+                    if (victim == worker) {
+                        index = queues[victim].front();
+                        queues[victim].pop_front();
+                    } else {
+                        index = queues[victim].back();
+                        queues[victim].pop_back();
+                    }
                 }
-                cout << "\t" << "|";
+                if (index < 0)
+                    break;
+
+                int alpha = sharedAlpha.load();
+                int score = search.scoreMove(localBoard, pieceType, hash, rootMoves[index], depth, alpha, Search::INFINITE_SCORE, 0);
+                if (search.isAborted)
+                    break;
+
+                // a score above the alpha it was searched with is exact, anything else is only an upper bound
+                lock_guard<mutex> lock(bestMutex);
+                if (score > bestScore && (score > alpha || bestIndex < 0)) {
+                    bestScore = score;
+                    bestIndex = index;
+                }
+                int current = sharedAlpha.load();
+                while (score > current && !sharedAlpha.compare_exchange_weak(current, score));
             }
-            cout << endl;
+            nodes += search.nodes;
+            if (search.isAborted)
+                aborted = true;
+        };
+
+        vector<thread> pool;
+        for (int i=1; i<workers; i++)
+            pool.push_back(thread(work, i));
+        work(0);
+        for (auto &worker: pool)
+            worker.join();
+
+        SolverResult result;
+        isAborted = aborted.load();
+        result.nodes = nodes.load();
+        if (bestIndex >= 0) {
+            result.row = rootMoves[bestIndex] / Size;
+            result.col = rootMoves[bestIndex] % Size;
+            result.score = bestScore;
+        }
+        return result;
+    }
+
+    template <int Size>
+    SolverResult search(GameBoard &gameBoard, PlayingPieceType pieceType, chrono::milliseconds budget, long long nodeLimit) {
+        auto start = chrono::steady_clock::now();
+        auto deadline = budget == chrono::milliseconds::max() ? chrono::steady_clock::time_point::max() : start + budget;
+        const ZobristKeys &keys = ZobristKeys::getInstance();
+
+        BitBoard<Size> board = BitBoard<Size>::fromGameBoard(gameBoard);
+        uint64_t hash = keys.sideToMove[pieceType];
+        rootMoves.clear();
+        for (int cell=0; cell<Size*Size; cell++) {
+            if (!board.isEmpty(cell / Size, cell % Size)) {
+                for (int i=0; i<BitBoard<Size>::PLAYERS; i++) {
+                    if (board.getPieces((PlayingPieceType)i) >> cell & 1)
+                        hash ^= keys.cells[i][cell];
+                }
+            } else {
+                rootMoves.push_back(cell);
+            }
+        }
+
+        SolverResult best;
+        if (rootMoves.empty())
+            return best;
+        best.row = rootMoves[0] / Size;
+        best.col = rootMoves[0] % Size;
+
+        long long nodes = 0;
+        for (int depth=1; depth<=(int)rootMoves.size(); depth++) {
+            bool isAborted = false;
+            SolverResult result = searchRoot<Size>(board, pieceType, hash, depth, deadline, nodeLimit - nodes, isAborted);
+            nodes += result.nodes;
+            if (isAborted || result.row < 0)
+                break;
+
+            best = result;
+            best.depth = depth;
+
+            // search the best move of this iteration first in the next one
+            int bestCell = result.row * Size + result.col;
+            rotate(rootMoves.begin(), find(rootMoves.begin(), rootMoves.end(), bestCell), find(rootMoves.begin(), rootMoves.end(), bestCell) + 1);
+
+            if (depth == (int)rootMoves.size() || abs(result.score) > AlphaBetaSearch<Size>::WIN_SCORE - 100) {
+                best.isSolved = true;
+                break;
+            }
+            if (chrono::steady_clock::now() >= deadline)
+                break;
+        }
+
+        best.nodes = nodes;
+        best.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return best;
+    }
+
+public:
+    GameSolver(int threads = max(1u, thread::hardware_concurrency()), size_t tableEntries = 1 << 20): table(tableEntries) {
+        this->threads = threads;
+    }
+
+    void setThreads(int threads) {
+        this->threads = max(1, threads);
+    }
+
+    /* Forgets all the positions searched so far */
+    void clear() {
+        table.clear();
+    }
+
+    /* A budget of milliseconds::max() searches without any time limit. With a single thread & no time limit the
+    search visits the same nodes on every run, so the move only depends on the position & the table. */
+    SolverResult findBestMove(GameBoard &board, PlayingPieceType pieceType, chrono::milliseconds budget = chrono::milliseconds(1000),
+            long long nodeLimit = LLONG_MAX) {
+        switch (board.size)
+        {
+            case 3: return search<3>(board, pieceType, budget, nodeLimit);
+            case 4: return search<4>(board, pieceType, budget, nodeLimit);
+            case 5: return search<5>(board, pieceType, budget, nodeLimit);
+            case 6: return search<6>(board, pieceType, budget, nodeLimit);
+            case 7: return search<7>(board, pieceType, budget, nodeLimit);
+            case 8: return search<8>(board, pieceType, budget, nodeLimit);
         }
+        throw invalid_argument("solver supports boards of size 3 to 8");
     }
 };
 
@@ -164,11 +832,18 @@ class TicTacToeGame
 public:
     std::deque<Player*> players;
     GameBoard *board;
+    GameSolver *solver;
+
+    /* A board of size x size where winLength in a row wins (the whole row by default), shared by 2 to 4 players.
+    The computer can only play the second player of a classic two player game. */
+    TicTacToeGame(int size = 3, int winLength = 0, int playerCount = 2, bool againstComputer = false) {
+        if (playerCount < 2 || playerCount > PIECE_TYPE_COUNT)
+            throw invalid_argument("a game needs between 2 and " + to_string(PIECE_TYPE_COUNT) + " players");
 
-    TicTacToeGame() {
-        this->board = new GameBoard(3);
-        players.push_back(new Player("Player1", new PlayingPieceX()));
-        players.push_back(new Player("Player2", new PlayingPieceO()));
+        this->board = new GameBoard(size, winLength);
+        this->solver = againstComputer ? new GameSolver() : NULL;
+        for (int i=0; i<playerCount; i++)
+            players.push_back(new Player("Player" + to_string(i + 1), createPlayingPiece((PlayingPieceType)i), againstComputer && i == 1));
     }
 
     void playGame() {
@@ -184,8 +859,15 @@ public:
 
             Player* currentPlayer = players.front();
             int row, col;
-            cout << "Enter the position to make the move: ";
-            cin >> row >> col;
+            if (currentPlayer->isComputer) {
+                SolverResult result = solver->findBestMove(*board, currentPlayer->playingPiece->pieceType);
+                row = result.row;
+                col = result.col;
+                cout << "Player " << currentPlayer->name << " plays " << row << " " << col << endl;
+            } else {
+                cout << "Enter the position to make the move: ";
+                cin >> row >> col;
+            }
 
             int success = this->board->makeMove(row, col, currentPlayer->playingPiece);
             if (!success) {
@@ -206,10 +888,1069 @@ public:
     }
 };
 
-/* Driver function */
-int main()
+/* =========================================================== */
+/* ======================== Simulation ======================= */
+/* =========================================================== */
+
+/* Strategy which decides the next move of a simulated player, nextPiece is the piece of the player moving after it.
+Policies may keep state (e.g. the solver's table), so every simulation thread plays with its own clone. */
+class MovePolicy
+{
+public:
+    virtual string getName() = 0;
+    virtual MovePolicy* clone() = 0;
+    virtual void chooseMove(GameBoard &board, PlayingPiece *piece, PlayingPiece *nextPiece, mt19937_64 &rng, int &row, int &col) = 0;
+    virtual ~MovePolicy() {}
+
+protected:
+    /* Picks one of the empty cells uniformly at random. Large boards are mostly empty so a few random probes usually
+    hit an empty cell, the scan for the n-th empty cell is only needed once the board fills up. */
+    static void chooseRandomMove(GameBoard &board, mt19937_64 &rng, int &row, int &col) {
+        int cells = board.size * board.size;
+        uniform_int_distribution<int> anyCell(0, cells - 1);
+        for (int attempt=0; attempt<8; attempt++) {
+            int cell = anyCell(rng);
+            row = cell / board.size;
+            col = cell % board.size;
+            if (board.isEmpty(row, col))
+                return;
+        }
+
+        int choice = uniform_int_distribution<int>(0, cells - board.filledCells - 1)(rng);
+        for (int cell=0; cell<cells; cell++) {
+            row = cell / board.size;
+            col = cell % board.size;
+            if (board.isEmpty(row, col) && choice-- == 0)
+                return;
+        }
+    }
+};
+
+class RandomPolicy: public MovePolicy
+{
+public:
+    string getName() {
+        return "random";
+    }
+
+    MovePolicy* clone() {
+        return new RandomPolicy();
+    }
+
+    void chooseMove(GameBoard &board, PlayingPiece *, PlayingPiece *, mt19937_64 &rng, int &row, int &col) {
+        chooseRandomMove(board, rng, row, col);
+    }
+};
+
+/* Wins if it can, otherwise blocks the winning move of the next player, otherwise plays at random */
+class GreedyPolicy: public MovePolicy
+{
+public:
+    string getName() {
+        return "greedy";
+    }
+
+    MovePolicy* clone() {
+        return new GreedyPolicy();
+    }
+
+    void chooseMove(GameBoard &board, PlayingPiece *piece, PlayingPiece *nextPiece, mt19937_64 &rng, int &row, int &col) {
+        for (PlayingPiece *target: {piece, nextPiece}) {
+            for (int r=0; r<board.size; r++) {
+                for (int c=0; c<board.size; c++) {
+                    if (board.isEmpty(r, c) && board.isWinningMove(r, c, target->pieceType)) {
+                        row = r;
+                        col = c;
+                        return;
+                    }
+                }
+            }
+        }
+        chooseRandomMove(board, rng, row, col);
+    }
+};
+
+/* Plays the move found by a single threaded GameSolver within the given number of nodes per move, so a simulation
+plays the same games on every run whatever the speed of the machine. The transposition table is kept between games,
+so once it is warm most positions are answered from the table. */
+class SolverPolicy: public MovePolicy
 {
-    TicTacToeGame game;
+    long long nodeLimit;
+    size_t tableEntries;
+    GameSolver solver;
+
+public:
+    SolverPolicy(long long nodeLimit = 100000, size_t tableEntries = 1 << 16): solver(1, tableEntries) {
+        this->nodeLimit = nodeLimit;
+        this->tableEntries = tableEntries;
+    }
+
+    string getName() {
+        return "solver";
+    }
+
+    MovePolicy* clone() {
+        return new SolverPolicy(nodeLimit, tableEntries);
+    }
+
+    void chooseMove(GameBoard &board, PlayingPiece *piece, PlayingPiece *, mt19937_64 &, int &row, int &col) {
+        SolverResult result = solver.findBestMove(board, piece->pieceType, chrono::milliseconds::max(), nodeLimit);
+        row = result.row;
+        col = result.col;
+    }
+};
+
+struct SimulationStats
+{
+    long long games = 0;
+    long long wins[PIECE_TYPE_COUNT] = {};  // by the position of the player in the turn order
+    long long draws = 0;
+    long long moves = 0;
+    long long allocations = 0;   // made after the warm up games of every thread
+    double seconds = 0;
+
+    double getGamesPerSecond() {
+        return games / max(seconds, 1e-9);
+    }
+};
+
+/* Plays many games between two or more policies without any console I/O. Games are split between the threads, every
+thread has its own RNG, policies and board, so threads share nothing until their counters are added up at the end and,
+once warmed up, a game does not allocate. The players take the pieces X, O, D & H in the order of the policies and the
+first policy always moves first. */
+class GameSimulator
+{
+    int size;
+    int winLength;
+    int threads;
+
+    static const int WARM_UP_GAMES = 16;
+
+    /* Returns the turn of the winner or -1 on a draw */
+    static int playGame(GameBoard &board, MovePolicy **policies, PlayingPiece **pieces, int players, mt19937_64 &rng, long long &moves) {
+        board.reset();
+        for (int turn=0; ; turn = (turn + 1) % players) {
+            if (!board.checkMoveAvailable())
+                return -1;
+
+            int row = -1, col = -1;
+            policies[turn]->chooseMove(board, pieces[turn], pieces[(turn + 1) % players], rng, row, col);
+            if (!board.makeMove(row, col, pieces[turn]))
+                throw logic_error(policies[turn]->getName() + " policy chose an invalid move");
+            moves++;
+
+            if (board.checkWinner(row, col, pieces[turn]))
+                return turn;
+        }
+    }
+
+public:
+    GameSimulator(int size = 3, int winLength = 0, int threads = max(1u, thread::hardware_concurrency())) {
+        this->size = size;
+        this->winLength = winLength;
+        this->threads = max(1, threads);
+    }
+
+    SimulationStats run(MovePolicy &first, MovePolicy &second, long long games, uint64_t seed = 1) {
+        return run(vector<MovePolicy*>{&first, &second}, games, seed);
+    }
+
+    SimulationStats run(const vector<MovePolicy*> &players, long long games, uint64_t seed = 1) {
+        int playerCount = players.size();
+        if (playerCount < 2 || playerCount > PIECE_TYPE_COUNT)
+            throw invalid_argument("a game needs between 2 and " + to_string(PIECE_TYPE_COUNT) + " players");
+
+        vector<SimulationStats> threadStats(threads);
+        auto start = chrono::steady_clock::now();
+
+        auto work = [&](int index) {
+            vector<unique_ptr<MovePolicy>> ownedPolicies;
+            vector<unique_ptr<PlayingPiece>> ownedPieces;
+            MovePolicy *policies[PIECE_TYPE_COUNT];
+            PlayingPiece *pieces[PIECE_TYPE_COUNT];
+            for (int i=0; i<playerCount; i++) {
+                ownedPolicies.emplace_back(players[i]->clone());
+                ownedPieces.emplace_back(createPlayingPiece((PlayingPieceType)i));
+                policies[i] = ownedPolicies[i].get();
+                pieces[i] = ownedPieces[i].get();
+            }
+            GameBoard board(size, winLength);
+            mt19937_64 rng(seed + index * 0x9E3779B97F4A7C15ULL);
+
+            SimulationStats &stats = threadStats[index];
+            stats.games = games / threads + (index < games % threads ? 1 : 0);
+            uint64_t allocationsBefore = getThreadAllocations();
+            for (long long game=0; game<stats.games; game++) {
+                if (game == WARM_UP_GAMES)
+                    allocationsBefore = getThreadAllocations();
+
+                int winner = playGame(board, policies, pieces, playerCount, rng, stats.moves);
+                if (winner >= 0)
+                    stats.wins[winner]++;
+                else
+                    stats.draws++;
+            }
+            stats.allocations = stats.games > WARM_UP_GAMES ? getThreadAllocations() - allocationsBefore : 0;
+        };
+
+        vector<thread> pool;
+        for (int i=1; i<threads; i++)
+            pool.push_back(thread(work, i));
+        work(0);
+        for (auto &worker: pool)
+            worker.join();
+
+        SimulationStats total;
+        for (auto &stats: threadStats) {
+            total.games += stats.games;
+            for (int i=0; i<PIECE_TYPE_COUNT; i++)
+                total.wins[i] += stats.wins[i];
+            total.draws += stats.draws;
+            total.moves += stats.moves;
+            total.allocations += stats.allocations;
+        }
+        total.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return total;
+    }
+};
+
+/* =========================================================== */
+/* ======================== Game Server ====================== */
+/* =========================================================== */
+
+/* A game hosted by the server. Both players of a session play over the same connection, X moves first. */
+struct GameSession
+{
+    GameBoard board;
+    int turn = 0;
+    uint32_t generation = 0;    // bumped when the session is released so that stale ids are rejected
+    bool isActive = false;
+    int ownerFd = -1;           // connection which created the session
+    size_t ownerSlot = 0;       // position of the session in the owner's list of sessions
+
+    GameSession(int size): board(size) {
+
+    }
+};
+
+/* Slab of game sessions. Sessions are allocated in slabs of SLAB_SIZE which never move and are recycled through a free
+list, so a new game only resets a board which is already allocated. A session id is its index in the low 32 bits and
+its generation in the high 32 bits. */
+class SessionPool
+{
+    static const size_t SLAB_SIZE = 4096;
+
+    int boardSize;
+    size_t capacity;
+    vector<vector<GameSession>> slabs;
+    vector<uint32_t> freeList;
+    size_t activeCount = 0;
+
+    GameSession& getSession(uint32_t index) {
+        return slabs[index / SLAB_SIZE][index % SLAB_SIZE];
+    }
+
+public:
+    static const uint64_t INVALID_SESSION = ~0ULL;
+
+    SessionPool(size_t capacity, int boardSize = 3) {
+        this->capacity = capacity;
+        this->boardSize = boardSize;
+        this->freeList.reserve(capacity);
+    }
+
+    /* Returns the id of a new session or INVALID_SESSION if the pool is full */
+    uint64_t create() {
+        if (freeList.empty()) {
+            size_t total = slabs.size() * SLAB_SIZE;
+            if (total >= capacity)
+                return INVALID_SESSION;
+
+            slabs.push_back(vector<GameSession>());
+            slabs.back().reserve(SLAB_SIZE);
+            for (size_t i=0; i<SLAB_SIZE; i++)
+                slabs.back().emplace_back(boardSize);
+            for (size_t i=SLAB_SIZE; i>0; i--)
+                freeList.push_back(total + i - 1);
+        }
+
+        uint32_t index = freeList.back();
+        freeList.pop_back();
+        GameSession &session = getSession(index);
+        session.board.reset();
+        session.turn = 0;
+        session.isActive = true;
+        activeCount++;
+        return (uint64_t)session.generation << 32 | index;
+    }
+
+    /* Returns the session with the given id or NULL if it does not exist (anymore) */
+    GameSession* find(uint64_t id) {
+        uint32_t index = id & 0xFFFFFFFF;
+        if (index >= slabs.size() * SLAB_SIZE)
+            return NULL;
+        GameSession &session = getSession(index);
+        if (!session.isActive || session.generation != (id >> 32))
+            return NULL;
+        return &session;
+    }
+
+    void release(uint64_t id) {
+        GameSession *session = find(id);
+        if (session == NULL)
+            return;
+        session->isActive = false;
+        session->generation++;
+        freeList.push_back(id & 0xFFFFFFFF);
+        activeCount--;
+    }
+
+    size_t getActiveCount() {
+        return activeCount;
+    }
+};
+
+/* Opens a stream socket for an address which is either a TCP port on localhost or the path of a Unix socket */
+int openGameSocket(const string &address, bool isServer)
+{
+    bool isTcp = !address.empty() && all_of(address.begin(), address.end(), ::isdigit);
+    int fd = socket(isTcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw runtime_error("unable to create socket: " + string(strerror(errno)));
+
+    sockaddr_storage storage = {};
+    socklen_t length;
+    if (isTcp) {
+        sockaddr_in *inet = (sockaddr_in*)&storage;
+        inet->sin_family = AF_INET;
+        inet->sin_port = htons(stoi(address));
+        inet->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        length = sizeof(sockaddr_in);
+
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        if (isServer)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    } else {
+        sockaddr_un *local = (sockaddr_un*)&storage;
+        local->sun_family = AF_UNIX;
+        strncpy(local->sun_path, address.c_str(), sizeof(local->sun_path) - 1);
+        length = sizeof(sockaddr_un);
+        if (isServer)
+            unlink(address.c_str());
+    }
+
+    int result = isServer ? bind(fd, (sockaddr*)&storage, length) : connect(fd, (sockaddr*)&storage, length);
+    if (result == 0 && isServer)
+        result = listen(fd, SOMAXCONN);
+    if (result != 0) {
+        string error = strerror(errno);
+        close(fd);
+        throw runtime_error("unable to " + string(isServer ? "listen on " : "connect to ") + address + ": " + error);
+    }
+    return fd;
+}
+
+/* Hosts many concurrent games on a single thread driven by epoll. Clients send one command per line:
+    NEW                     -> OK <id>, or ERR server full
+    MOVE <id> <row> <col>   -> OK, WIN X / WIN O or TIE once the move ends the game, or ERR <reason>
+    QUIT <id>               -> OK
+A finished game is released immediately and so are the games of a client which disconnects. A client sending a line
+longer than MAX_LINE_LENGTH is disconnected, and one which does not read its replies is not read from while more than
+OUTPUT_HIGH_WATER bytes of replies wait for it, so no client holds more than a few buffers of memory. */
+class GameServer
+{
+    static const size_t MAX_LINE_LENGTH = 256;
+    static const size_t OUTPUT_HIGH_WATER = 64 << 10;
+
+    struct ClientConnection {
+        bool isOpen = false;
+        uint32_t events = 0;   // watched by epoll
+        string input;
+        string output;
+        vector<uint64_t> sessions;
+    };
+
+    string address;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    SessionPool pool;
+    vector<ClientConnection> connections;   // indexed by fd
+    PlayingPieceX pieceX;
+    PlayingPieceO pieceO;
+    atomic<bool> isStopping{false};
+
+    void watch(int fd, uint32_t events, int operation) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, operation, fd, &event);
+    }
+
+    void acceptConnections() {
+        while (true)
+        {
+            int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+            if (fd < 0)
+                return;
+
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            if ((size_t)fd >= connections.size())
+                connections.resize(fd + 1);
+            connections[fd].isOpen = true;
+            connections[fd].events = EPOLLIN;
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void closeConnection(int fd) {
+        ClientConnection &connection = connections[fd];
+        for (uint64_t id: connection.sessions)
+            pool.release(id);
+        connection.sessions.clear();
+        connection.input.clear();
+        connection.output.clear();
+        connection.isOpen = false;
+        connection.events = 0;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+        close(fd);
+    }
+
+    void addSession(int fd, uint64_t id) {
+        GameSession *session = pool.find(id);
+        session->ownerFd = fd;
+        session->ownerSlot = connections[fd].sessions.size();
+        connections[fd].sessions.push_back(id);
+    }
+
+    /* Releases a session and swaps the last session of its owner into its slot */
+    void removeSession(uint64_t id) {
+        GameSession *session = pool.find(id);
+        vector<uint64_t> &sessions = connections[session->ownerFd].sessions;
+        uint64_t last = sessions.back();
+        sessions[session->ownerSlot] = last;
+        pool.find(last)->ownerSlot = session->ownerSlot;
+        sessions.pop_back();
+        pool.release(id);
+    }
+
+    static const char* parseNumber(const char *begin, const char *end, long long &value) {
+        while (begin < end && *begin == ' ')
+            begin++;
+        auto result = from_chars(begin, end, value);
+        return result.ec == errc() ? result.ptr : NULL;
+    }
+
+    void handleCommand(int fd, const char *begin, const char *end) {
+        string &output = connections[fd].output;
+        string_view line(begin, end - begin);
+
+        if (line == "NEW") {
+            uint64_t id = pool.create();
+            if (id == SessionPool::INVALID_SESSION) {
+                output += "ERR server full\n";
+                return;
+            }
+            addSession(fd, id);
+            char buffer[32];
+            output += "OK ";
+            output.append(buffer, to_chars(buffer, buffer + sizeof(buffer), id).ptr);
+            output += '\n';
+            return;
+        }
+
+        bool isMove = line.substr(0, 5) == "MOVE ";
+        bool isQuit = line.substr(0, 5) == "QUIT ";
+        if (!isMove && !isQuit) {
+            output += "ERR unknown command\n";
+            return;
+        }
+
+        long long id = 0, row = 0, col = 0;
+        const char *next = parseNumber(begin + 5, end, id);
+        if (next != NULL && isMove && (next = parseNumber(next, end, row)) != NULL)
+            next = parseNumber(next, end, col);
+        if (next == NULL) {
+            output += "ERR malformed command\n";
+            return;
+        }
+
+        GameSession *session = pool.find(id);
+        if (session == NULL || session->ownerFd != fd) {
+            output += "ERR unknown session\n";
+            return;
+        }
+
+        if (isQuit) {
+            removeSession(id);
+            output += "OK\n";
+            return;
+        }
+
+        PlayingPiece *piece = session->turn == 0 ? (PlayingPiece*)&pieceX : (PlayingPiece*)&pieceO;
+        if (!session->board.makeMove(row, col, piece)) {
+            output += "ERR invalid move\n";
+            return;
+        }
+        session->turn ^= 1;
+
+        if (session->board.checkWinner(row, col, piece)) {
+            output += session->turn == 1 ? "WIN X\n" : "WIN O\n";
+            removeSession(id);
+        } else if (!session->board.checkMoveAvailable()) {
+            output += "TIE\n";
+            removeSession(id);
+        } else {
+            output += "OK\n";
+        }
+    }
+
+    static bool hasCompleteLine(const string &input) {
+        return memchr(input.data(), '\n', input.size()) != NULL;
+    }
+
+    /* Handles the complete lines received so far, the lines left once the replies pile up above OUTPUT_HIGH_WATER wait
+    until the client has read some */
+    void handleInput(int fd) {
+        ClientConnection &connection = connections[fd];
+        const char *begin = connection.input.data(), *end = begin + connection.input.size(), *line = begin;
+        for (const char *newline; connection.output.size() < OUTPUT_HIGH_WATER
+                && (newline = (const char*)memchr(line, '\n', end - line)) != NULL; line = newline + 1)
+            handleCommand(fd, line, newline > line && newline[-1] == '\r' ? newline - 1 : newline);
+        connection.input.erase(0, line - begin);
+    }
+
+    /* Sends as much of the pending output as the socket takes, handles the lines held back once the output is below
+    OUTPUT_HIGH_WATER again, and watches EPOLLOUT while some output is left & EPOLLIN while the output is not full */
+    void flushOutput(int fd) {
+        ClientConnection &connection = connections[fd];
+        while (true)
+        {
+            size_t sent = 0;
+            while (sent < connection.output.size())
+            {
+                ssize_t written = send(fd, connection.output.data() + sent, connection.output.size() - sent, MSG_NOSIGNAL);
+                if (written <= 0) {
+                    if (written < 0 && errno == EAGAIN)
+                        break;
+                    closeConnection(fd);
+                    return;
+                }
+                sent += written;
+            }
+            connection.output.erase(0, sent);
+
+            if (connection.output.size() >= OUTPUT_HIGH_WATER || !hasCompleteLine(connection.input))
+                break;
+            handleInput(fd);
+        }
+
+        uint32_t events = 0;
+        if (connection.output.size() < OUTPUT_HIGH_WATER)
+            events |= EPOLLIN;
+        if (!connection.output.empty())
+            events |= EPOLLOUT;
+        if (events != connection.events) {
+            watch(fd, events, EPOLL_CTL_MOD);
+            connection.events = events;
+        }
+    }
+
+    /* Handles every chunk as it is received, so the input only ever holds the lines held back & one partial line */
+    void readCommands(int fd) {
+        ClientConnection &connection = connections[fd];
+        char buffer[65536];
+        while (connection.output.size() < OUTPUT_HIGH_WATER)
+        {
+            ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+            if (count == 0 || (count < 0 && errno != EAGAIN)) {
+                closeConnection(fd);
+                return;
+            }
+            if (count < 0)
+                break;
+            connection.input.append(buffer, count);
+            handleInput(fd);
+            if (connection.input.size() > MAX_LINE_LENGTH && !hasCompleteLine(connection.input)) {
+                closeConnection(fd);
+                return;
+            }
+        }
+
+        flushOutput(fd);
+    }
+
+public:
+    GameServer(string address, size_t maxSessions = 1 << 20, int boardSize = 3): pool(maxSessions, boardSize) {
+        this->address = address;
+        this->listenFd = openGameSocket(address, true);
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+        this->epollFd = epoll_create1(0);
+        this->wakeFd = eventfd(0, EFD_NONBLOCK);
+        watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    ~GameServer() {
+        for (size_t fd=0; fd<connections.size(); fd++) {
+            if (connections[fd].isOpen)
+                close(fd);
+        }
+        close(listenFd);
+        close(epollFd);
+        close(wakeFd);
+        if (!all_of(address.begin(), address.end(), ::isdigit))
+            unlink(address.c_str());
+    }
+
+    /* Serves clients on the calling thread until stop() is called */
+    void run() {
+        epoll_event events[256];
+        while (!isStopping.load())
+        {
+            int count = epoll_wait(epollFd, events, 256, -1);
+            for (int i=0; i<count; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd)
+                    acceptConnections();
+                else if (fd == wakeFd)
+                    continue;
+                else if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    closeConnection(fd);
+                else if (events[i].events & EPOLLIN)
+                    readCommands(fd);
+                else if (events[i].events & EPOLLOUT)
+                    flushOutput(fd);
+            }
+        }
+    }
+
+    /* Can be called from any thread, run() returns once the loop wakes up */
+    void stop() {
+        isStopping = true;
+        uint64_t value = 1;
+        ssize_t written = write(wakeFd, &value, sizeof(value));
+        (void)written;
+    }
+
+    size_t getActiveSessions() {
+        return pool.getActiveCount();
+    }
+};
+
+struct LoadStats
+{
+    long long moves = 0;
+    long long games = 0;
+    double seconds = 0;
+    long long p50 = 0;
+    long long p99 = 0;
+    long long p999 = 0;
+
+    double getMovesPerSecond() {
+        return moves / max(seconds, 1e-9);
+    }
+};
+
+/* Load generator for a GameServer: every connection runs on its own thread, keeps gamesPerConnection games open at
+once and plays random moves round robin over them, waiting for every reply so that the latency of each move is known */
+class GameLoadGenerator
+{
+    string address;
+    int connections;
+    int gamesPerConnection;
+
+    struct LineClient {
+        int fd;
+        string buffer;
+
+        LineClient(const string &address) {
+            fd = openGameSocket(address, false);
+        }
+
+        ~LineClient() {
+            close(fd);
+        }
+
+        void sendLine(const string &line) {
+            for (size_t sent = 0; sent < line.size(); ) {
+                ssize_t written = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+                if (written <= 0)
+                    throw runtime_error("connection to the game server lost");
+                sent += written;
+            }
+        }
+
+        string readLine() {
+            size_t newline;
+            while ((newline = buffer.find('\n')) == string::npos) {
+                char chunk[4096];
+                ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+                if (count <= 0)
+                    throw runtime_error("connection to the game server lost");
+                buffer.append(chunk, count);
+            }
+            string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return line;
+        }
+
+        uint64_t newGame() {
+            sendLine("NEW\n");
+            string reply = readLine();
+            if (reply.compare(0, 3, "OK ") != 0)
+                throw runtime_error("game server refused a new game: " + reply);
+            return stoull(reply.substr(3));
+        }
+    };
+
+    struct ClientGame {
+        uint64_t id;
+        GameBoard board;
+        int turn = 0;
+
+        ClientGame(int size): board(size) {
+
+        }
+    };
+
+public:
+    GameLoadGenerator(string address, int connections = 8, int gamesPerConnection = 2048) {
+        this->address = address;
+        this->connections = connections;
+        this->gamesPerConnection = gamesPerConnection;
+    }
+
+    LoadStats run(chrono::milliseconds duration) {
+        vector<vector<uint32_t>> latencies(connections);
+        vector<long long> games(connections);
+        vector<exception_ptr> errors(connections);
+        chrono::steady_clock::time_point start, deadline;
+        atomic<int> ready{0};
+        atomic<bool> isStarted{false};
+
+        auto work = [&](int index) {
+            bool isReady = false;
+            try {
+                LineClient client(address);
+                RandomPolicy policy;
+                PlayingPieceX pieceX;
+                PlayingPieceO pieceO;
+                PlayingPiece *pieces[2] = {&pieceX, &pieceO};
+                mt19937_64 rng(index + 1);
+
+                vector<ClientGame> open(gamesPerConnection, ClientGame(3));
+                for (auto &game: open)
+                    game.id = client.newGame();
+                latencies[index].reserve(1 << 20);
+
+                // every connection opens its games before the clock starts
+                isReady = true;
+                ready++;
+                while (!isStarted.load())
+                    this_thread::yield();
+
+                char line[64];
+                for (size_t next = 0; chrono::steady_clock::now() < deadline; next = (next + 1) % open.size()) {
+                    ClientGame &game = open[next];
+                    int row = -1, col = -1;
+                    policy.chooseMove(game.board, pieces[game.turn], pieces[game.turn ^ 1], rng, row, col);
+                    game.board.makeMove(row, col, pieces[game.turn]);
+                    game.turn ^= 1;
+
+                    int length = snprintf(line, sizeof(line), "MOVE %llu %d %d\n", (unsigned long long)game.id, row, col);
+                    auto sent = chrono::steady_clock::now();
+                    client.sendLine(string(line, length));
+                    string reply = client.readLine();
+                    latencies[index].push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sent).count());
+
+                    if (reply.compare(0, 3, "ERR") == 0)
+                        throw runtime_error("game server rejected a move: " + reply);
+                    if (reply != "OK") {
+                        games[index]++;
+                        game.board.reset();
+                        game.turn = 0;
+                        game.id = client.newGame();
+                    }
+                }
+            } catch (...) {
+                errors[index] = current_exception();
+                if (!isReady)
+                    ready++;
+            }
+        };
+
+        vector<thread> pool;
+        for (int i=0; i<connections; i++)
+            pool.push_back(thread(work, i));
+        while (ready.load() < connections)
+            this_thread::yield();
+        start = chrono::steady_clock::now();
+        deadline = start + duration;
+        isStarted = true;
+        for (auto &worker: pool)
+            worker.join();
+        for (auto &error: errors) {
+            if (error)
+                rethrow_exception(error);
+        }
+
+        LoadStats stats;
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        vector<uint32_t> all;
+        for (int i=0; i<connections; i++) {
+            all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+            stats.games += games[i];
+        }
+        stats.moves = all.size();
+        if (!all.empty()) {
+            sort(all.begin(), all.end());
+            stats.p50 = all[all.size() / 2];
+            stats.p99 = all[(size_t)(all.size() * 0.99)];
+            stats.p999 = all[(size_t)(all.size() * 0.999)];
+        }
+        return stats;
+    }
+};
+
+/* =========================================================== */
+/* ======================== Benchmarks ======================= */
+/* =========================================================== */
+
+/* Fills boards from 3x3 up to 1024x1024 in random order checking for a winner & a tie after every move,
+the cost per move should stay flat as the board grows */
+void benchmarkMoves()
+{
+    PlayingPieceX pieceX;
+    PlayingPieceO pieceO;
+    mt19937 rng(42);
+
+    cout << "board\t\tns/move\tmoves ending the game" << endl;
+    for (int size: {3, 8, 32, 128, 512, 1024}) {
+        vector<int> cells(size * size);
+        iota(cells.begin(), cells.end(), 0);
+        shuffle(cells.begin(), cells.end(), rng);
+
+        GameBoard board(size);
+        int finishingMoves = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t i=0; i<cells.size(); i++) {
+            int r = cells[i] / size, c = cells[i] % size;
+            PlayingPiece *piece = i % 2 == 0 ? (PlayingPiece*)&pieceX : (PlayingPiece*)&pieceO;
+            board.makeMove(r, c, piece);
+            if (board.checkWinner(r, c, piece) || !board.checkMoveAvailable())
+                finishingMoves++;
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / cells.size();
+        cout << size << "x" << size << "\t\t" << ns << "\t" << finishingMoves << endl;
+    }
+}
+
+/* Random games on bit boards versus the pointer based GameBoard, ns per move and size of a position */
+template <int Size>
+void benchmarkBitBoard(int games)
+{
+    PlayingPieceX pieceX;
+    PlayingPieceO pieceO;
+    mt19937 rng(7);
+    vector<int> cells(Size * Size);
+    iota(cells.begin(), cells.end(), 0);
+
+    long long moves = 0, bitBoardWins = 0, gameBoardWins = 0;
+    double bitBoardNs = 0, gameBoardNs = 0;
+    for (int game=0; game<games; game++) {
+        shuffle(cells.begin(), cells.end(), rng);
+
+        auto start = chrono::steady_clock::now();
+        BitBoard<Size> bitBoard;
+        for (size_t i=0; i<cells.size(); i++) {
+            PlayingPieceType pieceType = i % 2 == 0 ? PlayingPieceType::PieceTypeX : PlayingPieceType::PieceTypeO;
+            bitBoard.makeMove(cells[i] / Size, cells[i] % Size, pieceType);
+            if (bitBoard.checkWinner(cells[i] / Size, cells[i] % Size, pieceType)) {
+                bitBoardWins++;
+                break;
+            }
+        }
+        auto mid = chrono::steady_clock::now();
+
+        GameBoard gameBoard(Size);
+        for (size_t i=0; i<cells.size(); i++) {
+            PlayingPiece *piece = i % 2 == 0 ? (PlayingPiece*)&pieceX : (PlayingPiece*)&pieceO;
+            gameBoard.makeMove(cells[i] / Size, cells[i] % Size, piece);
+            moves++;
+            if (gameBoard.checkWinner(cells[i] / Size, cells[i] % Size, piece)) {
+                gameBoardWins++;
+                break;
+            }
+        }
+        auto end = chrono::steady_clock::now();
+
+        bitBoardNs += chrono::duration<double, nano>(mid - start).count();
+        gameBoardNs += chrono::duration<double, nano>(end - mid).count();
+    }
+
+    if (bitBoardWins != gameBoardWins)
+        cout << "bit board and game board disagree on the winner" << endl;
+    cout << Size << "x" << Size << "\t" << sizeof(BitBoard<Size>) << " bytes\t" << bitBoardNs / moves
+         << "\t\t" << gameBoardNs / moves << endl;
+}
+
+/* Time to solve the empty 3x3 board, and depth reached on 4x4 within a fixed budget, for a growing number of threads */
+void benchmarkSolver()
+{
+    GameSolver solver;
+    vector<int> threadCounts = {1, 2, 4, 8};
+
+    cout << "board\tthreads\tdepth\tsolved\tms\tnodes\tnodes/s" << endl;
+    for (int size: {3, 4}) {
+        for (int threads: threadCounts) {
+            GameBoard board(size);
+            solver.setThreads(threads);
+            solver.clear();
+
+            chrono::milliseconds budget(size == 3 ? 60000 : 500);
+            SolverResult result = solver.findBestMove(board, PlayingPieceType::PieceTypeX, budget);
+            cout << size << "x" << size << "\t" << threads << "\t" << result.depth << "\t" << (result.isSolved ? "yes" : "no")
+                << "\t" << fixed << setprecision(1) << result.seconds * 1000 << "\t" << result.nodes
+                << "\t" << setprecision(0) << result.nodes / max(result.seconds, 1e-9) << defaultfloat << setprecision(6) << endl;
+        }
+    }
+}
+
+/* Headless games between every pair of policies on all the cores: throughput, results & allocations once warmed up */
+void benchmarkSimulation()
+{
+    RandomPolicy randomPolicy;
+    GreedyPolicy greedyPolicy;
+    SolverPolicy solverPolicy;
+    GameSimulator simulator(3);
+
+    struct Matchup {
+        MovePolicy *first;
+        MovePolicy *second;
+        long long games;
+    };
+    vector<Matchup> matchups = {
+        {&randomPolicy, &randomPolicy, 2000000},
+        {&greedyPolicy, &randomPolicy, 1000000},
+        {&greedyPolicy, &greedyPolicy, 1000000},
+        {&solverPolicy, &randomPolicy, 100000},
+        {&solverPolicy, &greedyPolicy, 100000},
+    };
+
+    cout << "X\tO\tgames\tgames/s\tX wins\tO wins\tdraws\tallocations/game" << endl;
+    for (auto &matchup: matchups) {
+        SimulationStats stats = simulator.run(*matchup.first, *matchup.second, matchup.games);
+        cout << matchup.first->getName() << "\t" << matchup.second->getName() << "\t" << stats.games << "\t"
+            << (long long)stats.getGamesPerSecond() << "\t" << stats.wins[0] << "\t" << stats.wins[1]
+            << "\t" << stats.draws << "\t" << (double)stats.allocations / stats.games << endl;
+    }
+}
+
+/* Random k in a row games for N players on large boards, where only the cells around every move are scanned */
+void benchmarkKInARow()
+{
+    RandomPolicy randomPolicy;
+    GreedyPolicy greedyPolicy;
+
+    struct Variant {
+        int size;
+        int winLength;
+        int players;
+        MovePolicy *policy;
+        long long games;
+    };
+    vector<Variant> variants = {
+        {15, 5, 2, &greedyPolicy, 20000},
+        {100, 5, 2, &randomPolicy, 20000},
+        {100, 5, 4, &randomPolicy, 20000},
+        {1000, 5, 3, &randomPolicy, 200},
+    };
+
+    cout << "board\tk\tplayers\tpolicy\tgames/s\tns/move\tmoves/game\tdraws\tallocations/game" << endl;
+    for (auto &variant: variants) {
+        GameSimulator simulator(variant.size, variant.winLength);
+        SimulationStats stats = simulator.run(vector<MovePolicy*>(variant.players, variant.policy), variant.games);
+        cout << variant.size << "x" << variant.size << "\t" << variant.winLength << "\t" << variant.players << "\t"
+            << variant.policy->getName() << "\t" << (long long)stats.getGamesPerSecond() << "\t"
+            << stats.seconds * 1e9 / stats.moves << "\t" << stats.moves / stats.games << "\t\t" << stats.draws << "\t"
+            << (double)stats.allocations / stats.games << endl;
+    }
+}
+
+/* Moves per second and move latency of a GameServer on localhost, over a Unix socket and over TCP */
+void benchmarkServer()
+{
+    cout << "socket\tconnections\tgames open\tmoves/s\tgames/s\tp50 ns\tp99 ns\tp99.9 ns" << endl;
+    for (string address: {string("/tmp/tictactoe-bench.sock"), string("47123")}) {
+        GameServer server(address);
+        thread loop(&GameServer::run, &server);
+
+        int connections = 8, gamesPerConnection = 2048;
+        LoadStats stats = GameLoadGenerator(address, connections, gamesPerConnection).run(chrono::milliseconds(2000));
+        server.stop();
+        loop.join();
+
+        cout << (isdigit(address[0]) ? "tcp" : "unix") << "\t" << connections << "\t\t" << connections * gamesPerConnection
+            << "\t\t" << (long long)stats.getMovesPerSecond() << "\t" << (long long)(stats.games / stats.seconds) << "\t"
+            << stats.p50 << "\t" << stats.p99 << "\t" << stats.p999 << endl;
+    }
+}
+
+/* Driver function, pass --bench to run the benchmarks instead of an interactive game, --engine to play against the computer,
+--rules <size> <k> <players> to play k in a row on a larger board,
+--serve <port|socket path> to host games and --load <port|socket path> [connections] [games per connection] [seconds]
+to run the load generator against a server */
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        if (!ALLOCATIONS_COUNTED)
+            cout << "allocations are only counted in bench builds (-DBENCH_BUILD)" << endl;
+        benchmarkMoves();
+
+        cout << "board\tposition\tbit board ns/move\tgame board ns/move" << endl;
+        benchmarkBitBoard<3>(200000);
+        benchmarkBitBoard<4>(100000);
+        benchmarkBitBoard<8>(20000);
+        benchmarkBitBoard<16>(2000);
+
+        benchmarkSolver();
+
+        benchmarkSimulation();
+
+        benchmarkKInARow();
+
+        benchmarkServer();
+        return 0;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--serve") {
+        GameServer server(argv[2]);
+        cout << "Serving games on " << argv[2] << endl;
+        server.run();
+        return 0;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--load") {
+        int connections = argc > 3 ? stoi(argv[3]) : 8;
+        int gamesPerConnection = argc > 4 ? stoi(argv[4]) : 2048;
+        int seconds = argc > 5 ? stoi(argv[5]) : 10;
+        LoadStats stats = GameLoadGenerator(argv[2], connections, gamesPerConnection).run(chrono::seconds(seconds));
+        cout << "moves/s " << (long long)stats.getMovesPerSecond() << ", games finished " << stats.games << ", latency p50 "
+            << stats.p50 << " ns, p99 " << stats.p99 << " ns, p99.9 " << stats.p999 << " ns" << endl;
+        return 0;
+    }
+
+    int size = 3, winLength = 0, playerCount = 2;
+    if (argc > 4 && string(argv[1]) == "--rules") {
+        size = stoi(argv[2]);
+        winLength = stoi(argv[3]);
+        playerCount = stoi(argv[4]);
+    }
+    bool againstComputer = argc > 1 && string(argv[1]) == "--engine";
+    TicTacToeGame game(size, winLength, playerCount, againstComputer);
     game.playGame();
 
     return 0;
@@ -1,4 +1,5 @@
 #include <bits/stdc++.h>
+#include "IdGenerator.h"
 using namespace std;
 
 /* =========================================================== */
@@ -58,7 +59,7 @@ public:
 /* User account information */
 class User {
 public:
-    int userId;
+    int64_t userId;
     string name;
     string email;
     string phone;
@@ -68,7 +69,7 @@ public:
     User() {};
 
     User(string name, string email, string phone) {
-        this->userId = time(NULL);
+        this->userId = IdGenerator::getInstance().nextId();
         this->name = name;
         this->email = email;
         this->phone = phone;
@@ -94,7 +95,7 @@ enum VehicleType {
 /* Holds vehicle related information & attributes */
 class Vehicle {
 public:
-    int vehicleId;
+    int64_t vehicleId;
     string name;
     string model;
     string description;
@@ -107,7 +108,7 @@ public:
     Vehicle() {};
 
     Vehicle(string name, string model, VehicleType vehicleType) {
-        this->vehicleId = time(NULL);
+        this->vehicleId = IdGenerator::getInstance().nextId();
         this->name = name;
         this->model = model;
         this->vehicleType = vehicleType;
@@ -147,7 +148,7 @@ class Invoice;
 /* Maps user to a vehicle from startTime to endTime */
 class Reservation {
 public: 
-    int reservationId;
+    int64_t reservationId;
     Vehicle vehicle;
     User user;
     int startTime;
@@ -160,7 +161,7 @@ public:
     Reservation() {};
 
     Reservation(User user, Vehicle vehicle, int stTime, int endTime, Location stLocation, Location endLocation) {
-        this->reservationId = time(NULL);
+        this->reservationId = IdGenerator::getInstance().nextId();
         this->user = user;
         this->vehicle = vehicle;
         this->startTime = stTime;
@@ -182,12 +183,12 @@ public:
 /* Invoice is associated with the reservation */
 class Invoice {
 public:
-    int invoiceId;
+    int64_t invoiceId;
     Reservation reservation;
     int charges;
 
     Invoice(Reservation reservation) {
-        this->invoiceId = time(NULL);
+        this->invoiceId = IdGenerator::getInstance().nextId();
         this->reservation = reservation;
 
         int duration = reservation.endTime - reservation.startTime;
@@ -206,14 +207,14 @@ enum PaymentStatus {
 /* Handles payment for vehicle rental using invoice */
 class Payment {
 public:
-    int paymentId;
+    int64_t paymentId;
     int paymentTime;
     int amount;
-    int reservationId;
+    int64_t reservationId;
     PaymentStatus status;
 
-    Payment(int amount, int reservationId) {
-        this->paymentId = time(NULL);
+    Payment(int amount, int64_t reservationId) {
+        this->paymentId = IdGenerator::getInstance().nextId();
         this->amount = amount;
         this->reservationId = reservationId;
         this->status = PaymentStatus::PROCESSING;